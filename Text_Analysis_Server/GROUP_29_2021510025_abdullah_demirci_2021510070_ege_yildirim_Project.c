@@ -1,739 +1,7042 @@
+#define _GNU_SOURCE      // for accept4
 #include <string.h>     // for strlen
 #include <sys/socket.h> // for socket
+#include <sys/epoll.h>  // for epoll event loop
+#include <sys/eventfd.h> // for waking the event loop from the workers
 #include <arpa/inet.h>  // for inet_addr
+#include <netinet/tcp.h> // for TCP_NODELAY
 #include <unistd.h>     // for write
 #include <stdio.h>      // for file
 #include <pthread.h>    //thread + mutex
 #include <stdlib.h>
+#include <limits.h> // for INT_MAX
 #include <ctype.h>
 #include <stdbool.h> // for boolean flag
+#include <errno.h>   // for EAGAIN
+#include <signal.h>  // for SIGPIPE and shutdown signals
+#include <stdint.h>  // for the 64-bit bit-vectors of the Levenshtein kernel
+#include <sys/mman.h> // for mapping the compiled dictionary
+#include <sys/stat.h> // for the size and the time of the dictionary file
+#include <fcntl.h>    // for open
+#include <stdatomic.h> // for publishing the versions of the dictionary
+#include <time.h>      // for the clock of the benchmark and the load test
+#include <stddef.h>    // for max_align_t, the alignment of the arenas
+#include <sys/wait.h>  // for waitpid, the supervisor restarts the worker processes
+#include <spawn.h>     // for posix_spawn, the compiled dictionary is made again after a compaction
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> // for the AVX2 and SSE4.1 Levenshtein kernels
+#define LEVENSHTEIN_X86 1
+#endif
+
+/*Build with -DCOUNT_ALLOCATIONS to count every allocation from the heap: STATS then shows the number (heap_allocations),
+so it can be checked that the requests of a client in the steady state do not allocate anything.*/
+#ifdef COUNT_ALLOCATIONS
+_Atomic unsigned long heap_allocations = 0;
+#define COUNT_ALLOCATION() atomic_fetch_add_explicit(&heap_allocations, 1, memory_order_relaxed)
+#define malloc(size) (COUNT_ALLOCATION(), malloc(size))
+#define calloc(count, size) (COUNT_ALLOCATION(), calloc(count, size))
+#define realloc(pointer, size) (COUNT_ALLOCATION(), realloc(pointer, size))
+#define strdup(text) (COUNT_ALLOCATION(), strdup(text))
+#define strndup(text, size) (COUNT_ALLOCATION(), strndup(text, size))
+#endif
 
 /*Global variables prepared to be the desired constant in the given project*/
 #define INPUT_CHARACTER_LIMIT 100
 #define OUTPUT_CHARACTER_LIMIT 200
 #define LEVENSHTEIN_LIST_LIMIT 5
 #define PORT_NUMBER 60000
+#define BATCH_PORT_NUMBER 60001
+#define DICTIONARY_FILE "basic_english2000.txt"
+#define COMPILED_DICTIONARY_FILE "basic_english2000.dict"
+#define DICTIONARY_LOG_FILE "basic_english2000.log"
 
 /*This buffer size is a size used for the remaining printing operations except for printing the input and output sections.*/
 /*If there are missing values ​​in the Levensthein formula, it is due to the buffer, not the algorithm.*/
 /*This problem is solved by increasing buffer_size*/
 #define BUFFER_SIZE 256
 
-/*The reason for using this kind of structure is to apply the Levensthein formula to the entire dictionary and keep it in an array.*/
+/*The bit-parallel Levenshtein kernel keeps one bit for every character of the word entered by the user.
+Two 64-bit blocks are enough for INPUT_CHARACTER_LIMIT, longer words are calculated with the dynamic programming table.
+LEVENSHTEIN_LANES is the number of dictionary words that the widest kernel calculates at the same time.*/
+#define LEVENSHTEIN_MAX_BLOCKS 2
+#define LEVENSHTEIN_LANES 4
+
+/*The threshold used while the list of the closest words is not full yet, so every word can still enter the list.*/
+#define NO_BOUND (INT_MAX / 2)
+
+/*The maximum number of events that the epoll loop takes from the kernel in one call.*/
+#define MAX_EVENTS 64
+
+/*A scan of the whole dictionary is divided between the workers when the dictionary file has at least PARALLEL_SCAN_WORDS words.
+A chunk of the scan has at least SCAN_CHUNK_WORDS words, so its words and offsets fit in the L2 cache, and a scan has at most SCAN_MAX_CHUNKS chunks.*/
+#define PARALLEL_SCAN_WORDS 100000
+#define SCAN_CHUNK_WORDS 16384
+#define SCAN_MAX_CHUNKS 256
+
+/*The largest edit distance that --symspell accepts. Every word has about length^distance deletions in the index,
+so a larger distance makes the index too big for a dictionary of any size.*/
+#define SYMSPELL_MAX_DISTANCE 3
+
+/*The number of requests that a batch client can have in flight. When it is reached, the client is not read
+until the oldest request has been answered.*/
+#define BATCH_MAX_IN_FLIGHT 64
+
+/*A document of the batch protocol is checked in windows of at most DOCUMENT_WINDOW_BYTES bytes: a window is read,
+its words are checked in parallel and the window is written back before the next one is read.
+The document is not read while more than DOCUMENT_OUTPUT_LIMIT bytes of its output wait for the client,
+so a connection never holds more than these two buffers, however large the document is.*/
+#define DOCUMENT_WINDOW_BYTES 16384
+#define DOCUMENT_OUTPUT_LIMIT (4 * DOCUMENT_WINDOW_BYTES)
+
+/*The results of the words are kept in a cache that is divided into CACHE_SHARDS parts with their own locks,
+so the workers that look up different words do not wait for each other.
+CACHE_MEMORY_BUDGET is the default size of the cache in megabytes, it can be changed with --cache-memory (0 turns the cache off).*/
+#define CACHE_SHARDS 16
+#define CACHE_MEMORY_BUDGET 16
+
+/*The memory of a request is taken from an arena in blocks of at least ARENA_BLOCK_SIZE bytes.*/
+#define ARENA_BLOCK_SIZE 4096
+
+/*The bytes received from a client that are not used yet. A line longer than this is rejected anyway,
+so the buffer only has to hold a few pipelined answers. It is a ring, so the size has to be a power of 2.*/
+#define RECEIVE_BUFFER_SIZE 1024
+
+/*The benchmark measures every engine, dictionary size and word length for at least BENCHMARK_SECONDS.
+The load test keeps the last LOAD_BUFFER_SIZE bytes that a server sent to one of its connections, enough for the longest prompt.*/
+#define BENCHMARK_SECONDS 0.2
+#define LOAD_BUFFER_SIZE 4096
+
+/*A latency histogram has HISTOGRAM_SUB_BUCKETS buckets for every power of two nanoseconds (HDR histogram),
+so every duration from a nanosecond to years is kept with an error of at most 1 / HISTOGRAM_SUB_BUCKETS.
+With --stats-file the statistics are written to the file every STATS_INTERVAL seconds.*/
+#define HISTOGRAM_SUB_BUCKETS 8
+#define HISTOGRAM_BUCKETS (64 * HISTOGRAM_SUB_BUCKETS)
+#define STATS_INTERVAL 10
+
+/*A session that waits for its client is closed when nothing has come from the client or gone to it for IDLE_TIMEOUT seconds
+(--idle-timeout, 0 turns it off). A client that does not read its output for WRITE_TIMEOUT seconds is closed in every state,
+because its output is kept in the memory of the server. The sessions are checked every SWEEP_INTERVAL_MS milliseconds.*/
+#define IDLE_TIMEOUT 300
+#define WRITE_TIMEOUT 30
+#define SWEEP_INTERVAL_MS 1000
+
+/*The words that the users add are appended to the log of the dictionary (DICTIONARY_LOG_FILE) instead of rewriting the dictionary file.
+When LOG_COMPACT_WORDS words are in the log, the flusher thread writes a new sorted dictionary file and the log starts again empty.*/
+#define LOG_COMPACT_WORDS 256
+
+/*With --processes the supervisor starts a worker process again when it stops, but not more often than every WORKER_RESTART_SECONDS,
+so a worker that cannot start does not make the supervisor fork all the time.*/
+#define WORKER_RESTART_SECONDS 1.0
+
+/*The published words that the socket of a worker does not take at once wait in the backlog of the worker in the supervisor.
+A worker whose backlog grows beyond WORKER_BACKLOG_BYTES has not read its socket for a long time,
+so it is stopped and started again with the whole dictionary.*/
+#define WORKER_BACKLOG_BYTES (1024 * 1024)
+
+/*The reason for using this kind of structure is to keep the closest dictionary words of a word together with their differences.
+The word is not copied, it is the number of the word in the dictionary (see dictionaryWord), NO_WORD for an empty place.*/
 typedef struct
 {
-    char stringName[INPUT_CHARACTER_LIMIT + 1];
+    uint32_t word;
     int diff;
 } LevInfo;
 
-/*The reason for creating this structure is to be able to send more than one element to the function called threadFunction
-(the word itself, the order in which the id words will be written, and to be able to perform socket write operations).*/
+/*The set of the dictionary words for the question "is this word in the dictionary?". It is an open addressing hash table
+of word numbers with linear probing that is at most half full, so a word is found or missed after a few slots without any
+Levenshtein calculation. The writer fills empty slots in place; a reader ignores the numbers that are newer than its version.
+When the table would be more than half full, a table of twice the size is published with the next version.*/
+typedef struct
+{
+    uint32_t mask;            // the number of slots - 1, the number of slots is a power of two
+    _Atomic uint32_t slot[]; // word numbers, NO_WORD for an empty slot
+} WordSet;
+
+/*The symmetric delete index (SymSpell) of the dictionary. Every string that is made by deleting at most symspell_distance
+characters of a dictionary word is a key, and the list of the key holds the numbers of the words that give it.
+Two words whose difference is at most symspell_distance always share a key, so the keys of the word entered by the user
+give every dictionary word that is close enough, without visiting the others.
+Only the FNV-1a hash of a key is kept instead of its characters. Two keys with the same hash share a list,
+which only gives a few more candidates, because every candidate is checked with boundedLevenshtein anyway.
+The index is read by the workers without any lock like the WordSet: a list is appended in place and published by its count,
+a full list or table is replaced by a larger copy and the old one is retired.*/
+typedef struct
+{
+    _Atomic int count;
+    int capacity;
+    uint32_t word[];
+} DeleteList;
+
+typedef struct
+{
+    _Atomic uint32_t key;
+    DeleteList *_Atomic list; // NULL for an empty slot
+} DeleteSlot;
+
+typedef struct
+{
+    uint32_t mask; // the number of slots - 1, the number of slots is a power of two
+    DeleteSlot slot[];
+} DeleteIndex;
+
+#define NO_WORD UINT32_MAX
+
+/*The dictionary is kept as a structure of arrays instead of one heap string for every word.
+The words of the dictionary file are packed one after another into base_characters, sorted by length,
+so the words of the same length are next to each other and a scan reads the memory from the beginning to the end.
+The words added while the server runs are appended to a second arena, so the numbers of the words never change.
+The length of every word is kept and is never calculated again with strlen.*/
+typedef struct
+{
+    const char *base_characters;  // the words of the dictionary file, each ended with '\0'
+    const uint32_t *base_offsets; // base_count + 1 offsets into base_characters
+    const uint8_t *base_lengths;
+    uint32_t base_count;
+    uint32_t buckets[INPUT_CHARACTER_LIMIT + 2]; // the base words of length l are buckets[l] ... buckets[l + 1] - 1
+    /*Only the event loop uses the fields below, the workers read the added words through a DictionaryVersion.*/
+    char *characters;             // the words added while the server runs, each ended with '\0'
+    size_t character_size;
+    size_t character_capacity;
+    uint32_t *offsets;            // the offsets of the added words into characters
+    uint8_t *lengths;             // the lengths of the added words
+    uint32_t added_capacity;
+    uint32_t count;               // the number of words, a new word gets count as its number
+    WordSet *members;
+    uint32_t member_count;        // the different words in members
+    DeleteIndex *deletes;         // NULL if the symmetric delete index is not used
+    uint32_t delete_keys;         // the used slots of deletes
+    void *mapping;                // the compiled dictionary that the base arrays point into, NULL if they were allocated
+    size_t mapping_size;
+} Dictionary;
+
+/*A version of the dictionary as the workers see it. A version is never changed after it is published:
+adding a word creates a new version. The added words are appended after the end of the arrays of the old version,
+where its readers never look, and the arrays are copied only when they are full.*/
+typedef struct
+{
+    uint32_t count; // base_count + the added words of this version
+    const char *characters;
+    const uint32_t *offsets;
+    const uint8_t *lengths;
+    const WordSet *members;
+    const DeleteIndex *deletes;
+} DictionaryVersion;
+
+/*Every worker announces the epoch in which it started to read the dictionary (0 when it does not read it).
+A memory block that was replaced in an epoch can be freed when every reader has started after that epoch.
+The slots are on their own cache lines, so the workers do not slow each other down.*/
+typedef struct
+{
+    _Atomic unsigned long epoch;
+    char padding[64 - sizeof(unsigned long)];
+} ReaderSlot;
+
+typedef struct RetiredBlock
+{
+    void *pointer;
+    unsigned long epoch; // the epoch in which the block stopped being reachable for new readers
+    struct RetiredBlock *next;
+} RetiredBlock;
+
+/*The reason for using this structure is to prepare the word entered by the user only once for all dictionary words.
+For every character c, peq[b][c] has the bit i set if the character i of the block b of the word is c.*/
+typedef struct
+{
+    const char *text;
+    int length;
+    int blocks; // 0 for an empty word, LEVENSHTEIN_MAX_BLOCKS + 1 if the word is too long for the bit-vectors
+    uint64_t peq[LEVENSHTEIN_MAX_BLOCKS][256];
+} LevQuery;
+
+/*The kernel that calculates the differences of one prepared word with several dictionary words.
+It is chosen once at startup according to the instructions supported by the CPU.
+A word whose difference is certainly more than its bound is given as bound + 1 without being finished.*/
+typedef void (*DistanceKernel)(const LevQuery *query, const char *const *words, const int *lengths, const int *bounds, int count, int *out);
+
+/*The node of the BK-tree that indexes the dictionary. Every child is kept with its Levenshtein difference to this node.
+The children of a node are read by the workers without any lock, so the list is never changed in place:
+a new child is added by publishing a copy of the list and the old list is freed when no worker can read it anymore.*/
+typedef struct BKNode BKNode;
+typedef struct
+{
+    int distance;
+    BKNode *node;
+} BKChild;
+
+typedef struct
+{
+    int count;
+    BKChild child[];
+} BKChildList;
+
+struct BKNode
+{
+    uint32_t word; // the number of the word in the dictionary
+    int length;
+    _Atomic int max_child_distance; // the largest difference of a child, -1 for a leaf
+    BKChildList *_Atomic children;  // NULL for a leaf
+};
+
+/*An element of the stack that is used while searching the BK-tree.*/
+typedef struct
+{
+    BKNode *node;
+    int lower_bound; // no word under this node can be closer than this
+} BKStackEntry;
+
+/*The compiled dictionary is a file that the server maps into its memory instead of parsing the text dictionary.
+It is created from the text file with --compile-dictionary. All numbers are 32 bits in the byte order of the machine.
+    header
+    offsets: word_count + 1 offsets of the words in the blob (the words are sorted by length, then alphabetically)
+    buckets: INPUT_CHARACTER_LIMIT + 2 word numbers, the words of length l are the words buckets[l] ... buckets[l + 1] - 1
+    tree:    word_count nodes of the BK-tree in breadth-first order, node 0 is the root (only if tree_offset is not 0)
+    blob:    the words, each ended with '\0'
+The size and the time of the text file are kept in the header. If the text file was changed after the compilation
+(for example by hand), the compiled file is out of date and the text file is loaded instead.
+When the server itself writes the text file again (compactDictionary), it compiles the dictionary again too.*/
+#define COMPILED_DICTIONARY_MAGIC "TASDICT"
+#define COMPILED_DICTIONARY_VERSION 2
+
+typedef struct
+{
+    char magic[8];
+    uint32_t format_version;
+    uint32_t word_count;
+    uint32_t offsets_offset;
+    uint32_t buckets_offset;
+    uint32_t tree_offset;
+    uint32_t blob_offset;
+    uint32_t blob_size;
+    uint32_t source_size;
+    int64_t source_time;
+} DictionaryHeader;
+
+/*A node of the stored BK-tree. Because the nodes are in breadth-first order,
+the children of a node are the nodes first_child ... first_child + child_count - 1.*/
+typedef struct
+{
+    uint32_t word;            // the number of the word
+    uint32_t parent_distance; // the difference to the parent node, 0 for the root
+    int32_t max_child_distance;
+    uint32_t first_child;
+    uint32_t child_count;
+} BKRecord;
+
+/*An entry of the result cache. It is in the hash chain of its bucket and in the least recently used list of its shard.
+version is the number of dictionary words when the result was last brought up to date.*/
+typedef struct CacheEntry
+{
+    struct CacheEntry *hash_next;
+    struct CacheEntry *newer; // towards the most recently used entry
+    struct CacheEntry *older; // towards the least recently used entry
+    uint32_t hash;
+    uint32_t version;
+    size_t size; // the memory of the entry, counted against the budget of the shard
+    LevInfo result[LEVENSHTEIN_LIST_LIMIT];
+    char word[];
+} CacheEntry;
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    CacheEntry **buckets;
+    size_t bucket_count; // a power of two
+    size_t entry_count;
+    CacheEntry *newest;
+    CacheEntry *oldest;
+    size_t memory;
+    size_t budget;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+} CacheShard;
+
+/*Which words need the list of their closest words. The list is the expensive part of a word,
+the membership in the dictionary is answered by the WordSet first.*/
+typedef enum
+{
+    MATCHES_ALWAYS,  // every word, like the MATCHES line of the telnet dialogue
+    MATCHES_UNKNOWN, // only the words that are not in the dictionary
+    MATCHES_NEVER    // no word, only the membership is needed
+} MatchMode;
+
+/*Every connected client is in exactly one of these states. The server never waits for a client,
+it only remembers what the client was asked last and continues from there when the answer arrives.*/
+typedef enum
+{
+    SESSION_AWAIT_INPUT,   // "Please enter your input string" was sent
+    SESSION_SCORING,       // the next word to write is still being calculated by the thread pool
+    SESSION_AWAIT_CONFIRM, // "Do you want to add this word to dictionary?" was sent for the current word
+    SESSION_AWAIT_AGAIN,   // "Would you like to enter another input?" was sent
+    SESSION_BATCH,         // a client of the batch protocol, it never waits for a question
+    SESSION_CLOSING        // Good bye was sent, the connection is closed when the pending output is written
+} SessionState;
+
+/*What the batch protocol does with a word that is not in the dictionary.*/
+typedef enum
+{
+    POLICY_CORRECT, // the closest word is written to the output, like answering N
+    POLICY_ADD,     // the word is added to the dictionary and written to the output, like answering y
+    POLICY_REPORT,  // nothing is changed, the word is written to the output as it is
+    POLICY_STATS,   // no sentence, the statistics of the server are written
+    POLICY_DOCUMENT // the request is followed by a document of any size that is corrected and streamed back
+} BatchPolicy;
+
+/*The stages of a request whose durations are measured.*/
+typedef enum
+{
+    STAGE_RECEIVE, // one recv call on a client socket
+    STAGE_SPLIT,   // splitting a sentence into its words (splitSentence or the batch request)
+    STAGE_QUEUE,   // a word waiting in the thread pool until a worker takes it
+    STAGE_SEARCH,  // finding the closest words of a word, the cache included
+    STAGE_ORDER,   // a finished word waiting for its turn to be written
+    STAGE_SEND,    // one send call on a client socket
+    STAGE_COUNT
+} Stage;
+
+/*The durations of one stage measured by one thread. Only the owner thread writes it, without any lock or atomic addition
+(a relaxed load and store of its own counter cost the same as a normal increment), and STATS adds the histograms of the threads
+when somebody asks for them.*/
+typedef struct
+{
+    _Atomic uint64_t count[HISTOGRAM_BUCKETS];
+    _Atomic uint64_t sum; // nanoseconds
+} Histogram;
+
+typedef struct
+{
+    Histogram stage[STAGE_COUNT];
+    char padding[64]; // the next thread writes to another cache line
+} ThreadStatistics;
+
+/*The histograms of a stage added over every thread.*/
+typedef struct
+{
+    uint64_t count[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+} StageSummary;
+
+/*A task of the thread pool: the function and its argument. A task gives its result through its argument,
+the words through the completion queue of their session (completeWord).*/
+typedef struct
+{
+    void *(*function)(void *arg);
+    void *arg;
+} Task;
+
+/*Every worker of the pool has its own deque of tasks. The worker takes its own tasks from the bottom (newest first),
+an idle worker steals from the top of the deque of another worker (oldest first), so they rarely want the same task.*/
+typedef struct
+{
+    pthread_mutex_t mutex;
+    Task *tasks; // circular array
+    int head;    // index of the top (oldest) task
+    int count;
+    int capacity;
+} WorkDeque;
+
+/*The threads of the pool are created once when the server starts and live until it stops.*/
+typedef struct
+{
+    pthread_t *threads;
+    WorkDeque *deques;
+    int size;
+    pthread_mutex_t mutex; // only used to sleep while there is no task
+    pthread_cond_t cond;
+    int pending; // number of tasks in all deques, protected by mutex
+    int sleeping;
+    bool stopping;
+    unsigned int next_deque; // the deque that receives the next task given from outside the pool
+} ThreadPool;
+
+/*The log of the words added to the dictionary. The event loop only copies a word into pending, the flusher thread swaps
+pending with writing and writes it to the file with one fsync, so every word that was added while the last fsync was running
+is made durable by the next one (group commit). Nothing waits for the disk except the flusher.*/
+typedef struct
+{
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    char *pending; // the words that are not written yet, one on every line, protected by mutex
+    size_t pending_size;
+    size_t pending_capacity;
+    int pending_words;
+    char *writing; // the buffer that the flusher is writing, only the flusher uses it
+    size_t writing_capacity;
+    int logged_words; // the words in the file of the log since the last compaction, only the flusher uses it
+    int fd;
+    bool stopping;
+    bool started;
+    bool flusher; // the flusher thread is running, the supervisor of --processes writes the log itself
+} DictionaryLog;
+
+/*A worker process of --processes, seen from the supervisor. The words that the worker sends arrive on socket,
+buffer keeps the beginning of a word whose end has not arrived yet.
+The published words that the socket has not taken yet are kept in backlog, the first backlog_sent bytes are already written.
+blocked is true while the socket buffer is full, then nothing is tried until epoll says that it is writable.*/
+typedef struct
+{
+    pid_t pid; // 0 while the process is not running
+    int socket; // the end of the socket pair of the supervisor, -1 while the process is not running
+    double started; // monotonicSeconds
+    char buffer[INPUT_CHARACTER_LIMIT + 2];
+    int size;
+    char *backlog;
+    size_t backlog_length;
+    size_t backlog_capacity;
+    size_t backlog_sent;
+    bool blocked;
+} WorkerProcess;
+
+/*A scan of the dictionary that is divided between the workers (see scanParallel).
+The chunks are taken in the order of order, every chunk has its own heap of the closest words.
+The scan is given up by the worker that started it and by every helper, the last one keeps it in spare_scans.
+The worker that started the scan sleeps on cond until the worker that finishes the last chunk wakes it.*/
+typedef struct ScanJob
+{
+    const char *word;
+    int length;
+    uint32_t chunk_words;
+    int chunk_count;
+    uint16_t order[SCAN_MAX_CHUNKS];
+    _Atomic int next_chunk; // the place in order of the next chunk to take
+    _Atomic int finished_chunks;
+    _Atomic int bound; // no chunk needs a larger difference, see scanChunks
+    _Atomic int references;
+    LevInfo heaps[SCAN_MAX_CHUNKS][LEVENSHTEIN_LIST_LIMIT];
+    int found[SCAN_MAX_CHUNKS];
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    struct ScanJob *next;
+} ScanJob;
+
+/*A block of an arena, the memory of the allocations follows the header.*/
+typedef struct ArenaBlock
+{
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+} ArenaBlock;
+
+/*A bump allocator for memory that is released all at once: the memory of one request, or the scratch memory of one search.
+An allocation only moves the position in the current block, and nothing is freed one by one.
+arenaReset goes back to the first block and keeps all of them, so after the first requests the same blocks are used again
+and a request does not allocate anything from the heap.*/
+typedef struct
+{
+    ArenaBlock *first;
+    ArenaBlock *current;
+} Arena;
+
+typedef struct ThreadData ThreadData;
+
+/*The window of a document that is being corrected. The received bytes are collected in text. When the window is full,
+the document has ended or the client pauses, the words of text[0 .. cut) are given to the thread pool.
+A word at the end of the window may continue in the next bytes, so it is not checked yet: it stays in the window
+and is moved to its beginning when text[0 .. cut) has been written.*/
+typedef struct
+{
+    unsigned long long remaining; // the bytes of the document that are not received yet
+    char *text;
+    size_t length;
+    size_t cut;
+    bool in_flight;          // the words of text[0 .. cut) are in the thread pool or waiting to be written
+    bool skipping_long_word; // the last window ended inside a very long word, its next letters are written as they are
+    int word_count;
+    int *starts;             // the positions of the words in text
+    char *words;             // the words in small letters, each ended with '\0'
+    ThreadData *tasks;
+    Arena *window;           // the positions, the words and the tasks of the window, reset when the window is written
+    unsigned long total_words;
+    unsigned long corrected_words;
+} DocumentStream;
+
+/*One request of a batch client. The requests of a client are kept in the order they arrived
+and the replies are written in the same order, whichever request finishes first.*/
+typedef struct BatchRequest
+{
+    Arena arena;  // the input, the words and the tasks of the request
+    Arena window; // the windows of a document, kept with its blocks for the next document of the client
+    BatchPolicy policy;
+    DocumentStream *document; // only for POLICY_DOCUMENT
+    bool brief; // the WORD lines are written without the closest words
+    char *input;
+    char **words;
+    int word_count;
+    ThreadData *tasks;
+    const char *error_message; // the request was rejected, only the error is written
+    struct BatchRequest *next;
+} BatchRequest;
+
+/*One connection of the load test, it plays the user of a telnet session.*/
 typedef struct
+{
+    int socket;
+    int sessions_left; // the sessions that are started after the current one ends
+    int next_sentence; // the line of the script sent at the next input prompt
+    double sent;       // when the current sentence was sent
+    size_t used;
+    char buffer[LOAD_BUFFER_SIZE];
+} LoadClient;
+
+/*The reason for creating this structure is to keep everything that belongs to one telnet client together.
+Before the event loop there was only one client, so the socket, the output string and the turn of the words could be global.
+Now every client has its own socket, its own partial input, its own output string and its own position in the sentence.*/
+typedef struct Connection
+{
+    int socket;
+    SessionState state;
+    const char *error_message;
+
+    /*Bytes received from the client that are not used yet. The buffer is a ring: the bytes start at receive_start
+    and continue from the beginning of the buffer when they reach its end. Lines are used where they are, without copying them,
+    and are taken from the ring only when they have been handled (nextLine and consumeInput).
+    While the session is scoring, the lines that arrive are kept here and used when the answer is written.
+    input_overflow is true if the beginning of the current line was dropped because it did not fit, the line is rejected then.*/
+    char receive_buffer[RECEIVE_BUFFER_SIZE];
+    int receive_start;
+    int receive_length;
+    bool input_overflow;
+
+    /*The output of the client that is not written yet. Everything sent to the client is collected here
+    and written with one send at the end of the event (flushPendingOutput), the first pending_sent bytes are already written.
+    output_blocked is true while the socket buffer is full, then nothing is tried until epoll says that it is writable.*/
+    char *pending_output;
+    size_t pending_length;
+    size_t pending_capacity;
+    size_t pending_sent;
+    bool output_blocked;
+
+    /*The sentence that is currently processed and the position of the session in it.
+    Everything that belongs to the sentence is allocated in the arena, which is reset when the sentence ends.*/
+    Arena arena;
+    char *input;
+    char *split_text;   // one copy of the sentence in small letters, the words point into it
+    char **words;
+    int *repeat_of;     // the position of the previous occurrence of every word, -1 for its first occurrence
+    bool *added;        // the words that the user added to the dictionary, by position
+    int word_count;
+    int position;       // the position of the word that is written next
+    int counter;        // id of the current word in the whole sentence (WORD 01, WORD 02 ...)
+    ThreadData *tasks;  // Levenshtein tasks of the sentence, they hold the results in word order
+    char *Output_String;
+    int output_offset;
+
+    /*The ordered completion queue of the session. The workers finish the words in any order and mark them done
+    in tasks under completion_mutex, then put the session on the ready list of the event loop.
+    The event loop writes the finished words in word order and stops at the first word that is not finished.
+    The mutex is never held while writing to the socket.*/
+    pthread_mutex_t completion_mutex;
+    int outstanding;     // tasks given to the pool that have not finished yet (of all batch requests too)
+    bool in_ready_list;  // the session is already waiting in the ready list
+    bool closed;         // the socket is closed, the structure is released when outstanding becomes 0
+    struct Connection *next_ready;
+
+    /*The requests of a batch client in the order of arrival.*/
+    BatchRequest *first_request;
+    BatchRequest *last_request;
+    int request_count;
+    BatchRequest *spare_requests; // finished requests with their arenas, they are used again for the next requests
+    DocumentStream *document; // the document whose bytes are being received, the socket carries no lines until it ends
+
+    /*The place of the session in the list of open sessions, ordered by their last activity (touchConnection).*/
+    double last_active;  // the last time something was received from the client or written to it
+    double last_written; // the last time the output of the client moved, or started to wait
+    struct Connection *older;
+    struct Connection *newer;
+} Connection;
+
+/*The reason for creating this structure is to be able to send more than one element to the function called threadFunction
+(the word itself, the order in which the id words will be written and the place where the result will appear).*/
+struct ThreadData
 {
     char *word;
     int id;
-    int socket;
-} ThreadData;
+    Connection *conn;
+    LevInfo result[LEVENSHTEIN_LIST_LIMIT]; // written by the worker, it is read only after done is set under the completion_mutex
+    bool done;
+    uint32_t version; // the number of dictionary words when the result was calculated
+    MatchMode matches;
+    uint64_t submitted; // when the word was given to the thread pool
+    uint64_t finished;  // when its result was put into the completion queue
+};
 
 /*These are the functions used in the structure of the code. Below the main function, you will find clear explanations of all functions.*/
 /*Just above the contents of the functions, you can see what the functions do and what the variables in the contents of these functions do.*/
 void freeArray(char **array, int size);
 void addString(char ***array, int *size, int *capacity, const char *newString);
 void toLowerCase(char *str);
-LevInfo *calculateLevenshtein(const char *s1);
-LevInfo *TopWords(LevInfo *allWords, int totalWords);
+void calculateLevenshtein(const char *s1, LevInfo *result);
+void TopWords(LevInfo *heap, int found, LevInfo *result);
+void scanDictionary(const char *s1, LevInfo *result);
+void scanParallel(const char *s1, int len1, LevInfo *heap, int *found);
+void *scanHelper(void *arg);
+void scanChunks(ScanJob *job);
+void releaseScan(ScanJob *job);
+void freeSpareScans(void);
+int levenshteinDistance(const char *s1, int len1, const char *s2, int len2);
+void prepareQuery(LevQuery *query, const char *s1, int len1);
+int queryDistance(const LevQuery *query, const char *s2, int len2, int bound);
+int boundedLevenshtein(const char *s1, int len1, const char *s2, int len2, int bound);
+void distancesScalar(const LevQuery *query, const char *const *words, const int *lengths, const int *bounds, int count, int *out);
+void distancesSSE41(const LevQuery *query, const char *const *words, const int *lengths, const int *bounds, int count, int *out);
+void distancesAVX2(const LevQuery *query, const char *const *words, const int *lengths, const int *bounds, int count, int *out);
+void selectDistanceKernel(void);
+void insertBKTree(BKNode **root, uint32_t word);
+void pushTopWord(LevInfo *heap, int *found, uint32_t word, int diff);
+int topThreshold(const LevInfo *heap, int found);
+void searchBKTree(BKNode *root, const char *s1, LevInfo *result);
+void freeBKTree(BKNode *root);
+int wordDeletes(const char *word, int length, uint32_t **keys);
+void collectDeletes(const char *word, int length, int start, int left, uint32_t *keys, int *count);
+void buildDeleteIndex(void);
+void addDeletes(uint32_t index);
+void insertDelete(uint32_t key, uint32_t word);
+bool searchDeletes(const char *s1, LevInfo *result);
+void freeDeleteIndex(void);
+void addDictionaryWord(const char *word);
+void insertDictionaryWord(const char *word);
 int compareLevInfo(const void *a, const void *b);
-char *getInput(int newSocket);
-void freeArrayList(char ***array_list, int *sizes, int count);
-int isinArray(char **array, int size, const char *word);
-char ***SplitbyRepeatedWords(const char *input, const char *delim, int **sizes, int *count);
+char *getInput(Connection *conn, char *line, int length);
+char *nextLine(Connection *conn, int *length);
+void consumeInput(Connection *conn, int length);
+void splitSentence(Connection *conn, const char *input);
 void *threadFunction(void *arg);
-void MakeOutputString(int thread_id, char *word);
-int compareStrings(const void *a, const void *b);
-void clearScreen(int client_fd);
+void createCache(size_t budget);
+void freeCache(void);
+uint32_t hashWord(const char *word);
+bool cacheLookup(const char *word, uint32_t *version, LevInfo *result);
+void cacheStore(const char *word, uint32_t version, const LevInfo *result);
+void cacheUnlink(CacheShard *shard, CacheEntry *entry);
+void MakeOutputString(Connection *conn, int thread_id, const char *word);
+int compareWords(const void *a, const void *b);
+int compareNumbers(const void *a, const void *b);
+void clearScreen(Connection *conn);
+int loadDictionary(const char *path);
+int readDictionaryWords(const char *path, char ***words, int *size);
+void packDictionary(char **words, int size);
+const char *dictionaryWord(uint32_t index);
+int dictionaryLength(uint32_t index);
+const DictionaryVersion *dictionaryVersion(void);
+void publishDictionary(void);
+void syncWriterVersion(void);
+uint32_t findWord(const char *word);
+void addMember(uint32_t index);
+void membershipResult(uint32_t index, LevInfo *result);
+void createReaderSlots(int count);
+void readDictionary(void);
+void finishReading(void);
+void retireMemory(void *pointer);
+void reclaimMemory(void);
+int mapDictionary(const char *path, const char *source_path);
+int compileDictionary(const char *source_path, const char *path, bool with_tree);
+void buildDictionary(char **words, int size);
+double monotonicSeconds(void);
+uint64_t monotonicNanoseconds(void);
+void createStatistics(int count);
+void recordStage(Stage stage, uint64_t nanoseconds);
+int histogramBucket(uint64_t nanoseconds);
+uint64_t bucketLimit(int bucket);
+void summarizeStage(Stage stage, StageSummary *summary);
+uint64_t stagePercentile(const StageSummary *summary, double fraction);
+int formatStatistics(char *buffer, size_t size);
+void collectCacheCounters(unsigned long *hits, unsigned long *misses, unsigned long *evictions);
+int writeStatisticsFile(const char *path);
+int runBenchmark(long max_words);
+void makeBenchmarkQuery(char *query, int length, unsigned int *seed);
+int runLoadTest(int connections, int sessions, const char *script_path);
+int connectLoadClient(LoadClient *client, int epoll_instance);
+int compareSeconds(const void *a, const void *b);
+void sendLoadLine(LoadClient *client, const char *line);
+void freeDictionary(void);
+int compareLengths(const void *a, const void *b);
+int openDictionaryLog(const char *path, bool with_flusher);
+int replayDictionaryLog(int fd);
+void logDictionaryWord(const char *word);
+void *flushDictionaryLog(void *arg);
+void writePendingWords(void);
+int writeAll(int fd, const char *data, size_t size);
+int compactDictionary(const char *path);
+int recompileDictionary(const char *source_path, const char *path);
+void closeDictionaryLog(void);
+int serveClients(void);
+int workerThreads(void);
+int runSupervisor(int count);
+int startWorker(int number);
+void stopWorker(WorkerProcess *worker);
+void queueWorkerWords(WorkerProcess *worker, const char *line, int length);
+int flushWorkerBacklog(WorkerProcess *worker);
+void updateWorkerEvents(WorkerProcess *worker);
+int receiveWords(int fd, char *buffer, int *size, int capacity, void (*addWord)(const char *word));
+void publishWord(const char *word);
+void acceptPublishedWord(const char *word);
+void sendWordToSupervisor(const char *word);
+Connection *openConnection(int socket, bool batch);
+int openListener(int port);
+void acceptClients(int listener, bool batch);
+void handleBatchLine(Connection *conn, const char *line, int length);
+void processBatch(Connection *conn);
+void writeBatchReply(Connection *conn, BatchRequest *request);
+BatchRequest *newBatchRequest(Connection *conn);
+void recycleBatchRequest(Connection *conn, BatchRequest *request);
+void freeBatchRequest(BatchRequest *request);
+void refreshResult(LevInfo *result, const char *word, uint32_t version);
+const char *checkInput(const char *input);
+void closeConnection(Connection *conn);
+void touchConnection(Connection *conn);
+void unlinkConnection(Connection *conn);
+bool waitsForClient(Connection *conn);
+void sweepIdleSessions(void);
+int receiveInput(Connection *conn);
+void processInput(Connection *conn);
+void finishEvents(Connection *conn);
+void releaseConnection(Connection *conn);
+void freeReleasedConnections(void);
+void freeConnection(Connection *conn);
+void completeWord(ThreadData *data);
+void *arenaAlloc(Arena *arena, size_t size);
+void *arenaCalloc(Arena *arena, size_t count, size_t size);
+char *arenaCopy(Arena *arena, const char *text, size_t length);
+void arenaReset(Arena *arena);
+void freeArena(Arena *arena);
+void drainReadySessions(void);
+void sendToClient(Connection *conn, const char *text);
+void sendBytesToClient(Connection *conn, const char *data, size_t length);
+bool acceptsInput(Connection *conn);
+bool documentAcceptsInput(Connection *conn);
+void feedDocument(Connection *conn);
+void dispatchDocument(Connection *conn, bool pause);
+bool continueDocument(Connection *conn, BatchRequest *request);
+void writeDocumentWindow(Connection *conn, DocumentStream *document);
+int flushPendingOutput(Connection *conn);
+void startSession(Connection *conn);
+void handleLine(Connection *conn, char *line);
+void startSentence(Connection *conn, char *input);
+void startWords(Connection *conn);
+void submitWord(Connection *conn, int position);
+bool scheduleRepeat(Connection *conn, int position);
+int createThreadPool(ThreadPool *pool, int size);
+void destroyThreadPool(ThreadPool *pool);
+void submitTask(ThreadPool *pool, void *(*function)(void *), void *arg);
+bool takeTask(ThreadPool *pool, int index, Task *task);
+void runTask(Task *task);
+void *workerFunction(void *arg);
+void processWords(Connection *conn);
+void answerWord(Connection *conn, const char *answer);
+void finishSentence(Connection *conn);
+void freeSentence(Connection *conn);
+void endSession(Connection *conn);
+void updateEvents(Connection *conn);
+void handleSignal(int signal_number);
 
 /*Global variables: The reason they are global is that they are called by more than one function or as an element in more than one function.
 These variables are global and are seen in the necessary functions and main.*/
-int arraySize = 0;
-int arrayCapacity = 2;
-char **dict_array = NULL;
-char *error_message = NULL;
-int turn = 1;
-char *Output_String;
-int output_offset = 0;
+Dictionary dict;
+BKNode *bk_root = NULL;
+
+/*If the compiled dictionary has no BK-tree, use_bk_tree is false and the words are scanned in the order of their lengths.*/
+bool use_bk_tree = true;
+
+/*parallel_scan is true when the server has more than one worker. Then the BK-tree of a dictionary file that has at least
+PARALLEL_SCAN_WORDS words is not built, because all the workers scan the dictionary together (see scanParallel).*/
+bool parallel_scan = false;
+
+/*With --symspell <distance> the closest words are searched in the symmetric delete index first, which gives every word
+of the dictionary whose difference is at most symspell_distance. 0 means that the index is not built.*/
+int symspell_distance = 0;
+
+/*With --no-known-matches the telnet dialogue does not search the closest words of a word that is in the dictionary,
+its MATCHES line only contains the word itself.*/
+bool known_word_matches = true;
+
+/*The result cache and its memory budget in bytes.*/
+CacheShard cache_shards[CACHE_SHARDS];
+size_t cache_budget = (size_t)CACHE_MEMORY_BUDGET * 1024 * 1024;
+
+DistanceKernel distance_kernel = distancesScalar;
+int distance_lanes = 1;
+int epoll_fd = -1;
+int wakeup_fd = -1; // eventfd written by the workers when a session has finished words
 
-pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER; // Mutex lock
-pthread_cond_t cond = PTHREAD_COND_INITIALIZER;    // Conditional Variable
+/*The sessions that have finished words and are waiting for the event loop to write them.*/
+pthread_mutex_t ready_mutex = PTHREAD_MUTEX_INITIALIZER;
+Connection *ready_sessions = NULL;
+char wakeup_marker; // its address is the epoll data of wakeup_fd
+char batch_listener_marker; // its address is the epoll data of the batch listening socket
+ThreadPool pool;
+pthread_mutex_t scan_mutex = PTHREAD_MUTEX_INITIALIZER;
+ScanJob *spare_scans = NULL; // the scans that are given up, used again by the next parallel scan
+
+/*The workers read the dictionary while the event loop adds words to it, without any lock.
+dictionary_version is the newest version, reader_version the version that the current thread has taken with readDictionary.
+The blocks that a new version replaced wait in retired_blocks until no reader can see them (epoch based reclamation).
+Only the event loop writes the dictionary, retires and frees blocks.*/
+DictionaryVersion *_Atomic dictionary_version = NULL;
+DictionaryVersion writer_version; // what the event loop reads, it is ahead of dictionary_version while a word is being added
+__thread const DictionaryVersion *reader_version = NULL;
+_Atomic unsigned long global_epoch = 1;
+ReaderSlot *reader_slots = NULL;
+int reader_slot_count = 0;
+RetiredBlock *retired_blocks = NULL;
+DictionaryLog dictionary_log = {.fd = -1}; // see openDictionaryLog
+__thread int worker_index = -1; // index of the pool worker running this thread, -1 for the event loop
+__thread Arena scratch_arena = {NULL, NULL}; // the temporary memory of the searches of this thread, reset after every search
+
+/*The statistics of the event loop (element 0) and of every worker (element worker_index + 1).*/
+ThreadStatistics *statistics = NULL;
+int statistics_count = 0;
+__thread ThreadStatistics *thread_statistics = NULL; // NULL in a thread whose stages are not measured
+static const char *stage_names[STAGE_COUNT] = {"receive", "split", "queue", "search", "order", "send"};
+int active_sessions = 0;        // the connected clients, only the event loop changes it
+const char *stats_file = NULL;  // --stats-file, the statistics in the text format of Prometheus
+int idle_timeout = IDLE_TIMEOUT; // --idle-timeout, in seconds
+Connection *oldest_connection = NULL; // the list of open sessions, see touchConnection
+Connection *newest_connection = NULL;
+Connection *released_connections = NULL; // the closed sessions that are freed before the next epoll_wait, see releaseConnection
+volatile sig_atomic_t server_running = 1;
+
+/*With --processes <count> the server runs as a supervisor and count worker processes. Every worker binds the ports with SO_REUSEPORT,
+so the kernel gives the new connections to the workers in turn, and a worker that crashes only loses its own clients.
+The supervisor is the only writer of the dictionary file and its log: the workers send it the words that their clients add,
+and it sends every new word to all workers. supervisor_socket is the end of the socket pair of a worker, -1 in the other processes.*/
+int worker_processes = 1;
+WorkerProcess *workers = NULL;
+int supervisor_epoll = -1;
+int supervisor_socket = -1;
+char supervisor_marker; // its address is the epoll data of supervisor_socket
+char published_words[INPUT_CHARACTER_LIMIT + 2]; // the beginning of a word from the supervisor whose end has not arrived yet
+int published_size = 0;
+char worker_stats_file[PATH_MAX];
 
 int main(int argc, char *argv[])
 {
-    int socket_desc, new_socket, c;
-    struct sockaddr_in server, client;
-    char *message;
-    char *input;
-    int opt = 1; // Option value for SO_REUSEADDR
+    struct sigaction action;
+    int result;
 
-    // Create socket
-    socket_desc = socket(AF_INET, SOCK_STREAM, 0);
-    if (socket_desc == -1)
+    /*The server can also be used as the offline tool that creates the compiled dictionary:
+    ./server --compile-dictionary [--no-tree] basic_english2000.txt basic_english2000.dict*/
+    if (argc >= 2 && strcmp(argv[1], "--compile-dictionary") == 0)
     {
-        perror("Could not create socket");
-        return 1;
+        bool with_tree = argc >= 3 && strcmp(argv[2], "--no-tree") == 0 ? false : true;
+        int first = with_tree ? 2 : 3;
+        selectDistanceKernel();
+        if (argc != first + 2)
+        {
+            fprintf(stderr, "Usage: %s --compile-dictionary [--no-tree] <text dictionary> <compiled dictionary>\n", argv[0]);
+            return 1;
+        }
+        if (compileDictionary(argv[first], argv[first + 1], with_tree) != 0)
+        {
+            perror("The dictionary could not be compiled");
+            return 1;
+        }
+        return 0;
     }
 
-    /*The purpose of the code snippet specified in the if condition is to allow the user to use the port again immediately.
-    If this code snippet is to be removed, it is necessary to wait for the time determined by the OS.*/
-    if (setsockopt(socket_desc, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1)
+    long benchmark_words = 0;
+    int load_connections = 0, load_sessions = 0;
+    const char *load_script = NULL;
+    for (int i = 1; i < argc; i++)
     {
-        perror("setsockopt failed");
-        close(socket_desc);
+        if (strcmp(argv[i], "--benchmark") == 0)
+        {
+            benchmark_words = 1000000;
+            if (i + 1 < argc && atol(argv[i + 1]) > 0)
+            {
+                benchmark_words = atol(argv[++i]);
+            }
+        }
+        else if (strcmp(argv[i], "--load-test") == 0 && i + 2 < argc && atoi(argv[i + 1]) > 0 && atoi(argv[i + 2]) > 0)
+        {
+            load_connections = atoi(argv[++i]);
+            load_sessions = atoi(argv[++i]);
+            if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0)
+            {
+                load_script = argv[++i];
+            }
+        }
+        else if (strcmp(argv[i], "--cache-memory") == 0 && i + 1 < argc)
+        {
+            cache_budget = strtoull(argv[++i], NULL, 10) * 1024 * 1024;
+        }
+        else if (strcmp(argv[i], "--no-known-matches") == 0)
+        {
+            known_word_matches = false;
+        }
+        else if (strcmp(argv[i], "--stats-file") == 0 && i + 1 < argc)
+        {
+            stats_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--idle-timeout") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 0)
+        {
+            idle_timeout = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--symspell") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 1 && atoi(argv[i + 1]) <= SYMSPELL_MAX_DISTANCE)
+        {
+            symspell_distance = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--processes") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 1)
+        {
+            worker_processes = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--cache-memory <megabytes>] [--no-known-matches] [--symspell <distance 1-%d>] [--stats-file <path>]\n"
+                            "          [--idle-timeout <seconds>] [--processes <count>]\n",
+                    argv[0], SYMSPELL_MAX_DISTANCE);
+            fprintf(stderr, "       %s --compile-dictionary [--no-tree] <text dictionary> <compiled dictionary>\n", argv[0]);
+            fprintf(stderr, "       %s [--symspell <distance>] --benchmark [maximum dictionary size]\n", argv[0]);
+            fprintf(stderr, "       %s --load-test <connections> <sessions per connection> [script]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    /*The load test is only a client of a server that is already running on this machine.*/
+    if (load_connections > 0)
+    {
+        return runLoadTest(load_connections, load_sessions, load_script);
+    }
+
+    selectDistanceKernel();
+    if (benchmark_words > 0)
+    {
+        return runBenchmark(benchmark_words);
+    }
+    createCache(cache_budget);
+
+    /*The dictionary is read from the disk only once, before the server starts listening.
+    After this point every request reads the same dictionary and the words accepted by the users are added to it in place,
+    so the file is never parsed again while the server is running.
+    The compiled dictionary is used when it is up to date, it is mapped instead of parsed and the BK-tree is not built again.*/
+    parallel_scan = workerThreads() > 1;
+    if (mapDictionary(COMPILED_DICTIONARY_FILE, DICTIONARY_FILE) != 0 && loadDictionary(DICTIONARY_FILE) != 0)
+    {
+        perror("The dictionary could not be loaded");
+        return 1;
+    }
+    /*The dictionary file only has the words that were added before its last compaction, the later ones are in the log.
+    The supervisor of --processes writes the log itself, because a process that forks must not have other threads.*/
+    if (openDictionaryLog(DICTIONARY_LOG_FILE, worker_processes == 1) != 0)
+    {
+        perror("The dictionary log could not be opened");
         return 1;
     }
+    if (symspell_distance > 0)
+    {
+        buildDeleteIndex();
+    }
 
-    server.sin_family = AF_INET;
-    server.sin_addr.s_addr = INADDR_ANY;
-    server.sin_port = htons(PORT_NUMBER); // server will listen to 60000 port
+    /*A client that closes its telnet window while the server is writing to it must not kill the whole server,
+    so SIGPIPE is ignored and the failed write is handled like a disconnect.
+    SIGINT and SIGTERM stop the event loop so that the dictionary can be released properly.*/
+    signal(SIGPIPE, SIG_IGN);
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handleSignal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
 
-    // Bind
-    if (bind(socket_desc, (struct sockaddr *)&server, sizeof(server)) < 0)
+    /*With --processes the supervisor keeps the dictionary and the worker processes serve the clients,
+    otherwise this process serves them itself. The workers share the pages of the dictionary that is loaded here.*/
+    result = worker_processes > 1 ? runSupervisor(worker_processes) : serveClients();
+
+    closeDictionaryLog();
+    freeCache();
+    freeBKTree(bk_root);
+    freeDeleteIndex();
+    freeDictionary();
+    reclaimMemory(); // no worker is left, so every retired block is freed
+    freeSpareScans();
+    freeArena(&scratch_arena);
+    return result;
+}
+
+/*The purpose of this function is to give the number of the workers of the thread pool of a process that serves the clients.*/
+int workerThreads(void)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > worker_processes ? (int)cores / worker_processes : 1;
+}
+
+/*The purpose of this function is to serve the clients with the dictionary that main has loaded.
+It creates the workers of the thread pool, opens the listening sockets and runs the event loop until the server is stopped.
+Returns 0 when the server has stopped and 1 if it could not start.*/
+int serveClients(void)
+{
+    int socket_desc, batch_socket;
+    struct epoll_event event, events[MAX_EVENTS];
+
+    /*The Levenshtein calculations are done by a fixed number of worker threads, one for every core of the machine.
+    The threads are created here once, instead of one new thread for every word of every sentence.
+    With --processes the cores are divided between the worker processes.*/
+    int threads = workerThreads();
+    createReaderSlots(threads);
+    createStatistics(threads + 1);
+    thread_statistics = &statistics[0];
+    if (createThreadPool(&pool, threads) != 0)
+    {
+        perror("The thread pool could not be created");
+        return 1;
+    }
+
+    /*The telnet clients connect to PORT_NUMBER, the programs that use the batch protocol to BATCH_PORT_NUMBER.*/
+    socket_desc = openListener(PORT_NUMBER);
+    if (socket_desc == -1)
+    {
+        return 1;
+    }
+    batch_socket = openListener(BATCH_PORT_NUMBER);
+    if (batch_socket == -1)
     {
-        perror("Binding failed");
         close(socket_desc);
         return 1;
     }
-    puts("Socket is binded");
 
-    // Listen
-    if (listen(socket_desc, 3) < 0) // Start listening
+    /*The listening sockets and every client socket are registered to one epoll instance.
+    The telnet listening socket is registered with a NULL pointer, the batch one with the address of batch_listener_marker
+    and the clients with their Connection structure, so the loop below can tell them apart without searching.*/
+    epoll_fd = epoll_create1(0);
+    if (epoll_fd == -1)
     {
-        perror("Listen failed");
+        perror("epoll_create1 failed");
         close(socket_desc);
+        close(batch_socket);
+        return 1;
+    }
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket_desc, &event) == -1)
+    {
+        perror("epoll_ctl failed");
+        close(epoll_fd);
+        close(socket_desc);
+        close(batch_socket);
+        return 1;
+    }
+    event.data.ptr = &batch_listener_marker;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, batch_socket, &event) == -1)
+    {
+        perror("epoll_ctl failed");
+        close(epoll_fd);
+        close(socket_desc);
+        close(batch_socket);
         return 1;
     }
-    // Accept and incoming connection
-    puts("Waiting for incoming connections...");
 
-    c = sizeof(struct sockaddr_in);
-    new_socket = accept(socket_desc, (struct sockaddr *)&client, (socklen_t *)&c);
-    if (new_socket < 0)
+    /*The workers of the thread pool never write to a client. When they finish a word they wake the event loop
+    through this eventfd and the event loop writes the finished words of the session.*/
+    wakeup_fd = eventfd(0, EFD_NONBLOCK);
+    event.events = EPOLLIN;
+    event.data.ptr = &wakeup_marker;
+    if (wakeup_fd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wakeup_fd, &event) == -1)
+    {
+        perror("eventfd failed");
+        close(epoll_fd);
+        close(socket_desc);
+        close(batch_socket);
+        return 1;
+    }
+    /*A worker process of --processes also reads the words that the supervisor publishes.*/
+    event.data.ptr = &supervisor_marker;
+    if (supervisor_socket != -1 && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, supervisor_socket, &event) == -1)
     {
-        perror("Accept failed");
+        perror("epoll_ctl failed");
+        close(epoll_fd);
         close(socket_desc);
+        close(batch_socket);
         return 1;
     }
 
-    puts("Connection accepted");
-    message = "\n\nHello, this is Text Analysis Server!\n";
-    write(new_socket, message, strlen(message));
+    // Accept and incoming connection
+    puts("Waiting for incoming connections...");
 
-    while (true)
+    /*This is the event loop of the server. The loop never blocks on a single client.
+    New clients are accepted as long as the listening socket has them, and every client socket is only read
+    when the kernel says that there is something to read, so thousands of sessions can be open at the same time.*/
+    double next_dump = monotonicSeconds() + STATS_INTERVAL;
+    while (server_running)
     {
-        arraySize = 0;
-        arrayCapacity = 2;
-        error_message = NULL;
-        turn = 1;
-        /*The name of the variable may give a different impression to the reader,
-        but the main purpose of this variable is to ensure that the threads enter the mutex operation in order.*/
-
-        /*The dict_array variable basically serves to hold the lines in the text file. It is opened dynamically with malloc.
-        This will be seen in the add_String function in the following sections.*/
-        dict_array = malloc(arrayCapacity * sizeof(char *));
-        if (dict_array == NULL)
+        freeReleasedConnections(); // no event of the last epoll_wait is left that could point to them
+        int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, SWEEP_INTERVAL_MS);
+        sweepIdleSessions();
+        if (stats_file != NULL && monotonicSeconds() >= next_dump)
         {
-            error_message = "\nArray could not be created\n";
-            write(new_socket, error_message, strlen(error_message));
-            break;
+            if (writeStatisticsFile(stats_file) != 0)
+            {
+                perror("The statistics file could not be written");
+            }
+            next_dump = monotonicSeconds() + STATS_INTERVAL;
         }
-
-        // Open dictionary file
-        FILE *dictionary;
-        char line[INPUT_CHARACTER_LIMIT + 1];
-        if ((dictionary = fopen("basic_english_2000.txt", "r")) == NULL)
+        if (ready == -1)
         {
-            error_message = "\nThe file could not found\n";
-            write(new_socket, error_message, strlen(error_message));
-            free(dict_array);
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait failed");
             break;
         }
 
-        // Read dictionary words
-        while (fgets(line, sizeof(line), dictionary) != NULL)
+        for (int i = 0; i < ready; i++)
         {
-            line[strcspn(line, "\r\n")] = 0; // Remove newline character
-            toLowerCase(line);
-            addString(&dict_array, &arraySize, &arrayCapacity, line);
-        }
-        fclose(dictionary);
-        message = "\nPlease enter your input string:\n";
+            Connection *conn = (Connection *)events[i].data.ptr;
 
-        write(new_socket, message, strlen(message));
-        input = getInput(new_socket);
-        /*If the file process is completed successfully and no errors are found, the user enters an input in the next step.
-        The input entered by the user cannot be as desired in this code. In certain cases, messages are sent indicating that the input is incorrect.*/
-        /*If the length of the char*(string) variable called error_message is more than 0,
-        then the user has made one of the error conditions and in this case the code
-        completes the process by exiting the while loop and closes both the client and the server.*/
-        if (error_message != NULL)
-        {
-            if (strlen(error_message) > 0)
+            if (conn == NULL)
             {
-                write(new_socket, error_message, strlen(error_message));
-                free(input);
-                break;
+                acceptClients(socket_desc, false);
+                continue;
             }
-        }
-
-        /*If there is no contrary situation in the input phase, the code fragment will go to the end of the while loop and ask the user one last question,
-        even if an error occurs in any other case in the remaining designed code
-        (output specified in the project document or input cases related to the dictionary, etc.).*/
-        const char *delim = " "; // this variable is used to detect spaces.
-        int *sizes = NULL;       // List holding array sizes
-        int numberofArrays = 0;
-        int counter = 1; // this variable will be used later, its main purpose is to determine the order of the threads.
-
-        // Split arrays
-        char ***array_list = SplitbyRepeatedWords(input, delim, &sizes, &numberofArrays);
-
-        if (error_message != NULL)
-        {
-            if (strlen(error_message) > 0)
+            if (events[i].data.ptr == &batch_listener_marker)
             {
-                write(new_socket, error_message, strlen(error_message));
-                free(input);
-                break;
+                acceptClients(batch_socket, true);
+                continue;
             }
-        }
-
-        /*If there is no contrary situation after the array process is completed, the user can now be given the answer respectively.*/
-        /*The reason why the size of the output string is 2 more than the output_limit is the following.
-        snprintf, which will be used in the future, detects the characters in the specified buffer size even if you write as many characters as you want
-        (for write operation).For example, if you write 201 in the buffer size,
-        snprintf 200 detects at most 200 characters and puts a null terminator in the last character.
-        The reason why it is 2 more than Output_Limit is to give +1 error condition (to give 201 character error in this code fragment equal to output_limit 200).*/
-        Output_String = (char *)malloc((OUTPUT_CHARACTER_LIMIT + 2) * sizeof(char));
-
-        output_offset = 0; // offset is an integer variable used to print side by side with snprintf
-
-        /*The variable created by running the SplitbyRepeatedWords function will be used in this for loop.Unlike normal thread creation stages,
-        an extra for loop is required here.This is because it is not known exactly how many arrays the array_list variable holds.
-        If this variable holds more than one array, a separate loop state is required for each array.
-        It may seem a little slower than creating a thread from all elements and making a join,
-        but this is explained as much as possible in the example shown above in the SplitbyRepeatedWords code fragment.*/
-        for (int i = 0; i < numberofArrays; i++)
-        {
-            // Create thread array new for each group
-            pthread_t *threads = malloc(sizes[i] * sizeof(pthread_t));
-
-            for (int j = 0; j < sizes[i]; j++)
+            if (events[i].data.ptr == &wakeup_marker)
+            {
+                drainReadySessions();
+                continue;
+            }
+            if (events[i].data.ptr == &supervisor_marker)
             {
-                ThreadData *data = malloc(sizeof(ThreadData));
-                data->word = strdup(array_list[i][j]);
-                data->id = counter;
-                data->socket = new_socket;
-                // Create a thread for each word in the group to compare against dict_array
-                // threadFunction is a function that each thread goes to and is the part where the algorithm operations and printing are done.
-                if (pthread_create(&threads[j], NULL, threadFunction, (void *)data) != 0)
+                if (receiveWords(supervisor_socket, published_words, &published_size, sizeof(published_words), acceptPublishedWord) < 0)
                 {
-                    printf("Thread creation failed");
+                    server_running = 0; // the supervisor has stopped
                 }
-                counter++; // The counter variable id is incremented so that the states are different.
+                continue;
             }
+            if (conn->closed)
+            {
+                continue; // closed by the sweep or by an earlier event of this epoll_wait
+            }
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP))
+            {
+                closeConnection(conn);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT)
+            {
+                conn->output_blocked = false;
+                if (flushPendingOutput(conn) < 0)
+                {
+                    closeConnection(conn);
+                    continue;
+                }
+            }
+            if (events[i].events & EPOLLIN)
+            {
+                if (receiveInput(conn) < 0)
+                {
+                    closeConnection(conn);
+                    continue;
+                }
+            }
+            finishEvents(conn);
+        }
+    }
+
+    destroyThreadPool(&pool);
+    drainReadySessions(); // releases the closed sessions whose last tasks have just finished
+    freeReleasedConnections();
+    close(wakeup_fd);
+    if (stats_file != NULL && writeStatisticsFile(stats_file) != 0)
+    {
+        perror("The statistics file could not be written");
+    }
+    free(reader_slots);
+    reader_slots = NULL; // main reclaims the remaining blocks after the loop, no reader is left
+    reader_slot_count = 0;
+    free(statistics);
+    close(epoll_fd);
+    close(socket_desc);
+    close(batch_socket);
+
+    return 0;
+}
+
+/*The purpose of this function is to create a non-blocking listening socket on the given port.
+Returns the socket, or -1 after printing the reason.*/
+int openListener(int port)
+{
+    struct sockaddr_in server;
+    int opt = 1; // Option value for SO_REUSEADDR
+
+    // Create socket
+    int socket_desc = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (socket_desc == -1)
+    {
+        perror("Could not create socket");
+        return -1;
+    }
+
+    /*The purpose of the code snippet specified in the if condition is to allow the user to use the port again immediately.
+    If this code snippet is to be removed, it is necessary to wait for the time determined by the OS.*/
+    if (setsockopt(socket_desc, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1)
+    {
+        perror("setsockopt failed");
+        close(socket_desc);
+        return -1;
+    }
+    /*The worker processes of --processes bind the same port, the kernel divides the connections between them.*/
+    if (worker_processes > 1 && setsockopt(socket_desc, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == -1)
+    {
+        perror("setsockopt failed");
+        close(socket_desc);
+        return -1;
+    }
+
+    server.sin_family = AF_INET;
+    server.sin_addr.s_addr = INADDR_ANY;
+    server.sin_port = htons(port);
+
+    // Bind
+    if (bind(socket_desc, (struct sockaddr *)&server, sizeof(server)) < 0)
+    {
+        perror("Binding failed");
+        close(socket_desc);
+        return -1;
+    }
+    puts("Socket is binded");
+
+    // Listen
+    if (listen(socket_desc, SOMAXCONN) < 0) // Start listening
+    {
+        perror("Listen failed");
+        close(socket_desc);
+        return -1;
+    }
+    return socket_desc;
+}
+
+/*The purpose of this function is to accept every connection that is waiting on a listening socket.
+A telnet client is greeted and asked for its input, a batch client just waits for its first request.*/
+void acceptClients(int listener, bool batch)
+{
+    struct sockaddr_in client;
+    socklen_t c;
+
+    while (true)
+    {
+        c = sizeof(struct sockaddr_in);
+        int new_socket = accept4(listener, (struct sockaddr *)&client, &c, SOCK_NONBLOCK);
+        if (new_socket < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                perror("Accept failed");
+            }
+            break;
+        }
+        Connection *conn = openConnection(new_socket, batch);
+        if (conn == NULL)
+        {
+            close(new_socket);
+            continue;
+        }
+        puts("Connection accepted");
+        if (!batch)
+        {
+            startSession(conn);
+            finishEvents(conn);
+        }
+    }
+}
+
+/*The signal handler only tells the event loop to stop, everything else is done by main after the loop.*/
+void handleSignal(int signal_number)
+{
+    (void)signal_number;
+    server_running = 0;
+}
+
+// Session Informations
+
+/*The functions below replace the single while loop that served only one client before.
+Each of them does the part of the old loop between two questions and then returns to the event loop.
+When the answer of the client arrives, handleLine calls the function that continues from the state of the session.*/
+
+/*The purpose of this function is to create the structure of a newly accepted client and register it to epoll.*/
+Connection *openConnection(int socket, bool batch)
+{
+    struct epoll_event event;
+    Connection *conn = calloc(1, sizeof(Connection));
+    if (conn == NULL)
+    {
+        return NULL;
+    }
+    conn->socket = socket;
+    conn->state = batch ? SESSION_BATCH : SESSION_AWAIT_INPUT;
+
+    /*Every reply is written with one send, so waiting for more data with the algorithm of Nagle would only delay it.*/
+    int one = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    pthread_mutex_init(&conn->completion_mutex, NULL);
+
+    event.events = EPOLLIN;
+    event.data.ptr = conn;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket, &event) == -1)
+    {
+        perror("epoll_ctl failed");
+        free(conn);
+        return NULL;
+    }
+    active_sessions++;
+    touchConnection(conn);
+    return conn;
+}
+
+/*The purpose of this function is to close the socket of a client and to release everything that belongs to it.
+If some words of the client are still being calculated by the workers, the structure is released
+by drainReadySessions when the last of them has finished, because the workers still write into it.*/
+void closeConnection(Connection *conn)
+{
+    bool release;
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->socket, NULL);
+    close(conn->socket);
+    unlinkConnection(conn);
+    active_sessions--;
+    printf("%s\n", "The user's work is done");
+
+    pthread_mutex_lock(&conn->completion_mutex);
+    conn->closed = true;
+    release = conn->outstanding == 0 && !conn->in_ready_list;
+    pthread_mutex_unlock(&conn->completion_mutex);
+    if (release)
+    {
+        releaseConnection(conn);
+    }
+}
+
+/*The purpose of this function is to free the structure of a closed client whose words are all finished.
+It is only put on released_connections here and freed before the next epoll_wait,
+because the events of the current epoll_wait that are not handled yet can still point to it.*/
+void releaseConnection(Connection *conn)
+{
+    conn->next_ready = released_connections; // it is not in the ready list any more
+    released_connections = conn;
+}
+
+/*The purpose of this function is to free the structures of the released clients.*/
+void freeReleasedConnections(void)
+{
+    while (released_connections != NULL)
+    {
+        Connection *conn = released_connections;
+        released_connections = conn->next_ready;
+        freeConnection(conn);
+    }
+}
+
+/*The purpose of this function is to free everything that belongs to a closed client.*/
+void freeConnection(Connection *conn)
+{
+    freeSentence(conn);
+    freeArena(&conn->arena);
+    while (conn->first_request != NULL)
+    {
+        BatchRequest *request = conn->first_request;
+        conn->first_request = request->next;
+        freeBatchRequest(request);
+    }
+    while (conn->spare_requests != NULL)
+    {
+        BatchRequest *request = conn->spare_requests;
+        conn->spare_requests = request->next;
+        freeBatchRequest(request);
+    }
+    free(conn->pending_output);
+    pthread_mutex_destroy(&conn->completion_mutex);
+    free(conn);
+}
+
+/*The purpose of this function is to end the handling of the events of a client:
+the output collected during the events is written, a closing session is released as soon as everything
+that was written to it has left the server, otherwise the events that the client is interested in are updated.*/
+void finishEvents(Connection *conn)
+{
+    if (conn->pending_length > 0 && !conn->output_blocked && flushPendingOutput(conn) < 0)
+    {
+        closeConnection(conn);
+        return;
+    }
+    if (conn->state == SESSION_CLOSING && conn->pending_length == 0)
+    {
+        closeConnection(conn);
+        return;
+    }
+    updateEvents(conn);
+}
+
+/*The write interest of a client is only needed while there is output waiting for the socket.
+Otherwise epoll would wake the loop for every client whose socket is writable, which is almost always.
+While the session is scoring, the client is not read: its lines wait in the kernel until the answer has been written.
+A batch client is not read while it has BATCH_MAX_IN_FLIGHT requests waiting for their replies.*/
+void updateEvents(Connection *conn)
+{
+    struct epoll_event event;
+    event.events = acceptsInput(conn) ? EPOLLIN : 0;
+    if (conn->pending_length > 0)
+    {
+        event.events |= EPOLLOUT;
+    }
+    event.data.ptr = conn;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->socket, &event);
+}
+
+/*The purpose of this function is to tell whether the client is read now, see updateEvents.*/
+bool acceptsInput(Connection *conn)
+{
+    if (conn->state == SESSION_SCORING || conn->state == SESSION_CLOSING)
+    {
+        return false;
+    }
+    if (conn->document != NULL)
+    {
+        return documentAcceptsInput(conn);
+    }
+    return !(conn->state == SESSION_BATCH && conn->request_count >= BATCH_MAX_IN_FLIGHT);
+}
+
+// Idle Timeout Informations
+
+/*The purpose of this function is to note that something has happened on the session now.
+The open sessions are kept in a list from the oldest activity to the newest, and the session is moved to its newest end,
+so sweepIdleSessions only looks at the beginning of the list, however many sessions are open.*/
+void touchConnection(Connection *conn)
+{
+    conn->last_active = monotonicSeconds();
+    if (newest_connection == conn)
+    {
+        return;
+    }
+    unlinkConnection(conn);
+    conn->older = newest_connection;
+    if (newest_connection != NULL)
+    {
+        newest_connection->newer = conn;
+    }
+    else
+    {
+        oldest_connection = conn;
+    }
+    newest_connection = conn;
+}
+
+/*The purpose of this function is to take the session out of the list of open sessions.*/
+void unlinkConnection(Connection *conn)
+{
+    if (conn->older != NULL)
+    {
+        conn->older->newer = conn->newer;
+    }
+    else if (oldest_connection == conn)
+    {
+        oldest_connection = conn->newer;
+    }
+    if (conn->newer != NULL)
+    {
+        conn->newer->older = conn->older;
+    }
+    else if (newest_connection == conn)
+    {
+        newest_connection = conn->older;
+    }
+    conn->older = NULL;
+    conn->newer = NULL;
+}
+
+/*The purpose of this function is to tell whether the session can only continue with the next bytes of the client:
+a telnet session that waits for an answer, or a batch client that has nothing being calculated.
+A scoring session or a batch client with requests in the thread pool waits for the server, it is never idle.*/
+bool waitsForClient(Connection *conn)
+{
+    switch (conn->state)
+    {
+    case SESSION_AWAIT_INPUT:
+    case SESSION_AWAIT_CONFIRM:
+    case SESSION_AWAIT_AGAIN:
+        return true;
+    case SESSION_BATCH:
+        if (conn->document != NULL)
+        {
+            return documentAcceptsInput(conn);
+        }
+        return conn->first_request == NULL;
+    case SESSION_SCORING:
+    case SESSION_CLOSING:
+        break;
+    }
+    return false;
+}
+
+/*The purpose of this function is to close the sessions that have been idle for too long, so a client that went away
+without closing its connection does not keep its socket and its buffers forever.
+An idle telnet user gets a Good Bye, and a client that does not read is closed at once.
+The list is ordered by the last activity, so the loop stops at the first session that was active too recently for any timeout.*/
+void sweepIdleSessions(void)
+{
+    double now = monotonicSeconds();
+    double shortest = idle_timeout > 0 && idle_timeout < WRITE_TIMEOUT ? idle_timeout : WRITE_TIMEOUT;
+    Connection *conn = oldest_connection;
+
+    while (conn != NULL && now - conn->last_active >= shortest)
+    {
+        Connection *next = conn->newer;
+        if (conn->pending_length > 0 && now - conn->last_written >= WRITE_TIMEOUT)
+        {
+            closeConnection(conn);
+        }
+        else if (idle_timeout > 0 && now - conn->last_active >= idle_timeout && waitsForClient(conn))
+        {
+            if (conn->state != SESSION_BATCH)
+            {
+                sendToClient(conn, "\n\nThe session has been idle for too long. Good Bye!\n\n");
+            }
+            conn->state = SESSION_CLOSING; // the words of the sentence may still be calculated, releaseConnection frees them
+            finishEvents(conn);
+        }
+        conn = next;
+    }
+}
+
+/*The purpose of this function is to send a text to the client without waiting for it.
+The text is only appended to the output of the client. The WORD, MATCHES and presence lines of a word, the prompts and
+the lines of a batch reply are written together by flushPendingOutput when the event loop has finished with the client,
+so a reply is one system call and one packet instead of one for every line.
+The order of the texts is kept.*/
+void sendToClient(Connection *conn, const char *text)
+{
+    sendBytesToClient(conn, text, strlen(text));
+}
+
+/*The same as sendToClient for data that is not a string, like a window of a document.*/
+void sendBytesToClient(Connection *conn, const char *text, size_t length)
+{
+    if (conn->pending_sent > 0 && conn->pending_length + length > conn->pending_capacity)
+    {
+        // The written part of a blocked output is dropped before the buffer is made larger
+        memmove(conn->pending_output, conn->pending_output + conn->pending_sent, conn->pending_length - conn->pending_sent);
+        conn->pending_length -= conn->pending_sent;
+        conn->pending_sent = 0;
+    }
+    if (conn->pending_length + length > conn->pending_capacity)
+    {
+        size_t capacity = conn->pending_capacity == 0 ? BUFFER_SIZE : conn->pending_capacity;
+        while (capacity < conn->pending_length + length)
+        {
+            capacity *= 2;
+        }
+        char *temp = realloc(conn->pending_output, capacity);
+        if (temp == NULL)
+        {
+            perror("Error reallocating memory");
+            exit(EXIT_FAILURE);
+        }
+        conn->pending_output = temp;
+        conn->pending_capacity = capacity;
+    }
+    if (conn->pending_length == 0)
+    {
+        conn->last_written = monotonicSeconds(); // the output starts to wait for the client now
+        touchConnection(conn);
+    }
+    memcpy(conn->pending_output + conn->pending_length, text, length);
+    conn->pending_length += length;
+}
 
-            // Wait for all threads in this group to finish
-            for (int j = 0; j < sizes[i]; j++)
+/*The purpose of this function is to write the output that is waiting for the client.
+If the socket takes only a part of it, the position is remembered in pending_sent, so the rest is not moved,
+and the socket is not tried again until epoll says that it is writable (output_blocked).
+Returns -1 if the client is gone and 0 otherwise (also when only a part of the output could be written).*/
+int flushPendingOutput(Connection *conn)
+{
+    while (conn->pending_sent < conn->pending_length)
+    {
+        uint64_t start = monotonicNanoseconds();
+        ssize_t result = send(conn->socket, conn->pending_output + conn->pending_sent, conn->pending_length - conn->pending_sent, MSG_NOSIGNAL);
+        recordStage(STAGE_SEND, monotonicNanoseconds() - start);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                conn->output_blocked = true;
+                return 0;
+            }
+            return -1;
+        }
+        conn->pending_sent += result;
+        conn->last_written = monotonicSeconds();
+        touchConnection(conn);
+    }
+    conn->pending_length = 0;
+    conn->pending_sent = 0;
+    return 0;
+}
+
+/*The purpose of this function is to read what the client has sent into the receive buffer and to use the complete lines.
+Unlike the old getInput, which assumed that one recv is one line, the bytes after the end of a line are kept for the next line
+and a line that arrives in more than one piece is put together before it is used.
+Returns -1 if the client disconnected or recv failed.*/
+int receiveInput(Connection *conn)
+{
+    while (acceptsInput(conn))
+    {
+        DocumentStream *document = conn->document;
+        if (document != NULL && conn->receive_length == 0)
+        {
+            /*The bytes of a document are received into its window, without going through the receive buffer.*/
+            size_t space = DOCUMENT_WINDOW_BYTES - document->length;
+            if (space > document->remaining)
+            {
+                space = document->remaining;
+            }
+            uint64_t start = monotonicNanoseconds();
+            ssize_t bytes_received = recv(conn->socket, document->text + document->length, space, 0);
+            recordStage(STAGE_RECEIVE, monotonicNanoseconds() - start);
+            if (bytes_received == 0)
+            {
+                return -1;
+            }
+            if (bytes_received < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    dispatchDocument(conn, true); // the client pauses, the complete words are checked already
+                    return 0;
+                }
+                return -1;
+            }
+            touchConnection(conn);
+            document->length += bytes_received;
+            document->remaining -= bytes_received;
+            if (document->length == DOCUMENT_WINDOW_BYTES || document->remaining == 0)
+            {
+                dispatchDocument(conn, false);
+            }
+            continue;
+        }
+        if (conn->receive_length == RECEIVE_BUFFER_SIZE)
+        {
+            /*The whole buffer is one line without an end, it is far too long anyway.
+            Its beginning is dropped and the line will be rejected when its end arrives.*/
+            conn->receive_start = 0;
+            conn->receive_length = 0;
+            conn->input_overflow = true;
+        }
+        /*The free part of the ring that follows the received bytes, up to the end of the buffer or up to receive_start.*/
+        int end = (conn->receive_start + conn->receive_length) & (RECEIVE_BUFFER_SIZE - 1);
+        int space = end < conn->receive_start ? conn->receive_start - end : RECEIVE_BUFFER_SIZE - end;
+        uint64_t start = monotonicNanoseconds();
+        ssize_t bytes_received = recv(conn->socket, conn->receive_buffer + end, space, 0);
+        recordStage(STAGE_RECEIVE, monotonicNanoseconds() - start);
+        if (bytes_received == 0)
+        {
+            return -1;
+        }
+        if (bytes_received < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
             {
-                pthread_join(threads[j], NULL);
+                if (conn->document != NULL)
+                {
+                    dispatchDocument(conn, true);
+                }
+                return 0;
             }
+            return -1;
+        }
+        touchConnection(conn);
+        conn->receive_length += bytes_received;
+        processInput(conn);
+    }
+    return 0;
+}
 
-            free(threads); // Free the thread array after the group is processed
+/*The purpose of this function is to hand the complete lines in the receive buffer to handleLine one by one.
+It stops when the session starts scoring, the remaining lines are used when the scoring has finished.*/
+void processInput(Connection *conn)
+{
+    while (conn->state != SESSION_SCORING && conn->state != SESSION_CLOSING)
+    {
+        if (conn->document != NULL)
+        {
+            feedDocument(conn);
+            if (conn->document != NULL)
+            {
+                return; // the lines after the document wait until it has ended
+            }
+            continue;
+        }
+        if (conn->state == SESSION_BATCH && conn->request_count >= BATCH_MAX_IN_FLIGHT)
+        {
+            return;
+        }
+        int line_length;
+        char *line = nextLine(conn, &line_length);
+        if (line == NULL)
+        {
+            return;
         }
 
-        /*After the user sees the Levensthein answers and the dictionary possibilities,
-        the input and output answers are written to the screen. If the limit is exceeded,
-        an error is printed and the user cannot add the words to the dictionary even if he wants to.
-        Otherwise, the new words are written to the dictionary in a sorted manner.*/
-        toLowerCase(input);
-        write(new_socket, "\nINPUT: ", strlen("\nINPUT: "));
-        write(new_socket, input, strlen(input));
-        if (strlen(Output_String) > OUTPUT_CHARACTER_LIMIT)
+        if (conn->state == SESSION_BATCH)
         {
-            error_message = "\nError: Ouput exceeds OUTPUT_CHARACTER_LIMIT characters.";
-            write(new_socket, error_message, strlen(error_message));
+            handleBatchLine(conn, line, line_length);
         }
         else
         {
-            write(new_socket, "\nOUTPUT: ", strlen("\nOUTPUT: "));
-            write(new_socket, Output_String, strlen(Output_String));
-
-            qsort(dict_array, arraySize, sizeof(char *), compareStrings);
-
-            dictionary = fopen("basic_english_2000.txt", "w");
-
-            if (dictionary == NULL)
-            {
-                error_message = "\nThe file could not found\n";
-                write(new_socket, error_message, strlen(error_message));
-                free(dict_array);
-                break;
-            }
-            for (int j = 0; j < arraySize; j++)
+            handleLine(conn, getInput(conn, line, line_length));
+        }
+        conn->input_overflow = false;
+        consumeInput(conn, line_length + 1);
+    }
+}
+
+/*The purpose of this function is to find the next complete line in the receive ring.
+Returns the line where it is in the ring and its length without the \n, or NULL if the end of the line has not arrived yet.
+A line that continues from the end of the buffer to its beginning is the only case that is not a view by itself,
+then the ring is turned once so that the bytes start at the beginning of the buffer.*/
+char *nextLine(Connection *conn, int *length)
+{
+    int first = RECEIVE_BUFFER_SIZE - conn->receive_start;
+    char *end;
+
+    if (first > conn->receive_length)
+    {
+        first = conn->receive_length;
+    }
+    end = memchr(conn->receive_buffer + conn->receive_start, '\n', first);
+    if (end != NULL)
+    {
+        *length = end - (conn->receive_buffer + conn->receive_start);
+        return conn->receive_buffer + conn->receive_start;
+    }
+    end = memchr(conn->receive_buffer, '\n', conn->receive_length - first);
+    if (end == NULL)
+    {
+        return NULL;
+    }
+
+    char turned[RECEIVE_BUFFER_SIZE];
+    memcpy(turned, conn->receive_buffer + conn->receive_start, first);
+    memcpy(turned + first, conn->receive_buffer, conn->receive_length - first);
+    memcpy(conn->receive_buffer, turned, conn->receive_length);
+    conn->receive_start = 0;
+    *length = first + (end - conn->receive_buffer);
+    return conn->receive_buffer;
+}
+
+/*The purpose of this function is to take the first length bytes out of the receive ring after they have been used.
+An empty ring starts again at the beginning of the buffer, so the next lines are seldom split by its end.*/
+void consumeInput(Connection *conn, int length)
+{
+    conn->receive_start = (conn->receive_start + length) & (RECEIVE_BUFFER_SIZE - 1);
+    conn->receive_length -= length;
+    if (conn->receive_length == 0)
+    {
+        conn->receive_start = 0;
+    }
+}
+
+// Batch Protocol Informations
+
+/*The batch protocol is for programs instead of people. It is served on BATCH_PORT_NUMBER and has no questions.
+Every request is one line: a policy (correct, add or report), a space and the sentence, with the same rules as the telnet input.
+If the line starts with "brief ", the WORD lines are written without the closest words and they are only searched
+for the words that the correct policy has to replace.
+The reply of a request is
+    OK <number of words>
+    WORD <word> <PRESENT|CORRECTED|ADDED|ABSENT> <match> <diff> ... (one line for every word, LEVENSHTEIN_LIST_LIMIT matches)
+    OUTPUT <output string>
+or a single ERROR <message> line if the request is rejected (ERROR after the WORD lines if the output is too long).
+The request "stats" is answered with STATS <number of lines> and the lines of formatStatistics.
+The request "document <bytes>" is followed by a document of that many bytes, without any limit on its size.
+Every word of letters of the document that is not in the dictionary is replaced by its closest word, everything else is kept.
+The corrected document is streamed back while it is received as CHUNK <bytes> lines, each followed by that many bytes,
+and it ends with the line END <words> <corrected words>.
+A client can send many requests without waiting. All of them are calculated at the same time,
+and the replies are written in the order of the requests.*/
+
+/*The purpose of this function is to turn one line of a batch client into a request and to give its words to the thread pool.*/
+void handleBatchLine(Connection *conn, const char *line, int length)
+{
+    BatchRequest *request = newBatchRequest(conn);
+    const char *sentence;
+    int policy_length;
+
+    if (length > 0 && line[length - 1] == '\r')
+    {
+        length--;
+    }
+    if (length >= 6 && strncasecmp(line, "brief ", 6) == 0)
+    {
+        request->brief = true;
+        line += 6;
+        length -= 6;
+    }
+    sentence = memchr(line, ' ', length);
+    policy_length = sentence == NULL ? length : sentence - line;
+    if (policy_length == 7 && strncasecmp(line, "correct", 7) == 0)
+    {
+        request->policy = POLICY_CORRECT;
+    }
+    else if (policy_length == 3 && strncasecmp(line, "add", 3) == 0)
+    {
+        request->policy = POLICY_ADD;
+    }
+    else if (policy_length == 6 && strncasecmp(line, "report", 6) == 0)
+    {
+        request->policy = POLICY_REPORT;
+    }
+    else if (policy_length == 5 && strncasecmp(line, "stats", 5) == 0)
+    {
+        request->policy = POLICY_STATS;
+    }
+    else if (policy_length == 8 && strncasecmp(line, "document", 8) == 0)
+    {
+        request->policy = POLICY_DOCUMENT;
+        char *end = NULL;
+        unsigned long long size = sentence == NULL ? 0 : strtoull(sentence + 1, &end, 10);
+        if (sentence == NULL || end == sentence + 1 || end != line + length || sentence[1] == '-')
+        {
+            request->error_message = "Invalid document length, use document <bytes>";
+        }
+        else
+        {
+            request->document = arenaCalloc(&request->arena, 1, sizeof(DocumentStream));
+            request->document->text = arenaAlloc(&request->arena, DOCUMENT_WINDOW_BYTES);
+            request->document->window = &request->window;
+            request->document->remaining = size;
+            conn->document = request->document;
+        }
+    }
+    else
+    {
+        request->error_message = "Unknown policy, use correct, add or report";
+    }
+
+    if (request->error_message == NULL && request->policy != POLICY_STATS && request->policy != POLICY_DOCUMENT)
+    {
+        int sentence_length = sentence == NULL ? 0 : length - policy_length - 1;
+        if (sentence_length > INPUT_CHARACTER_LIMIT || conn->input_overflow)
+        {
+            request->error_message = "\nError: Input exceeds INPUT_CHARACTER_LIMIT characters.\n";
+        }
+        else
+        {
+            request->input = arenaCopy(&request->arena, sentence == NULL ? "" : sentence + 1, sentence_length);
+            request->error_message = checkInput(request->input);
+        }
+    }
+
+    if (request->error_message == NULL && request->policy != POLICY_STATS && request->policy != POLICY_DOCUMENT)
+    {
+        uint64_t start = monotonicNanoseconds();
+        size_t input_length = strlen(request->input);
+        char *temp = arenaCopy(&request->arena, request->input, input_length); // the words point into it
+        char *token = strtok(temp, " ");
+        toLowerCase(request->input);
+        request->words = arenaAlloc(&request->arena, (input_length / 2 + 1) * sizeof(char *));
+        while (token != NULL)
+        {
+            toLowerCase(token);
+            request->words[request->word_count++] = token;
+            token = strtok(NULL, " ");
+        }
+        recordStage(STAGE_SPLIT, monotonicNanoseconds() - start);
+
+        request->tasks = arenaCalloc(&request->arena, request->word_count, sizeof(ThreadData));
+        for (int j = 0; j < request->word_count; j++)
+        {
+            request->tasks[j].word = request->words[j];
+            request->tasks[j].id = j + 1;
+            request->tasks[j].conn = conn;
+            if (!request->brief)
+            {
+                request->tasks[j].matches = MATCHES_ALWAYS;
+            }
+            else
+            {
+                request->tasks[j].matches = request->policy == POLICY_CORRECT ? MATCHES_UNKNOWN : MATCHES_NEVER;
+            }
+        }
+        pthread_mutex_lock(&conn->completion_mutex);
+        conn->outstanding += request->word_count;
+        pthread_mutex_unlock(&conn->completion_mutex);
+        for (int j = 0; j < request->word_count; j++)
+        {
+            request->tasks[j].submitted = monotonicNanoseconds();
+            submitTask(&pool, threadFunction, &request->tasks[j]);
+        }
+    }
+
+    if (conn->last_request == NULL)
+    {
+        conn->first_request = request;
+    }
+    else
+    {
+        conn->last_request->next = request;
+    }
+    conn->last_request = request;
+    conn->request_count++;
+
+    processBatch(conn); // a rejected request or a request without words can be answered at once
+}
+
+/*The purpose of this function is to write the replies of the oldest requests whose words are all finished.
+It stops at the first request that still has a word in the thread pool, so the replies keep the order of the requests.*/
+void processBatch(Connection *conn)
+{
+    while (conn->first_request != NULL)
+    {
+        BatchRequest *request = conn->first_request;
+        bool finished = true;
+
+        if (request->document != NULL)
+        {
+            if (!continueDocument(conn, request))
+            {
+                return;
+            }
+            conn->first_request = request->next;
+            if (conn->first_request == NULL)
+            {
+                conn->last_request = NULL;
+            }
+            conn->request_count--;
+            recycleBatchRequest(conn, request);
+            continue;
+        }
+
+        pthread_mutex_lock(&conn->completion_mutex);
+        for (int j = 0; j < request->word_count; j++)
+        {
+            if (!request->tasks[j].done)
+            {
+                finished = false;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&conn->completion_mutex);
+        if (!finished)
+        {
+            return;
+        }
+
+        writeBatchReply(conn, request);
+        conn->first_request = request->next;
+        if (conn->first_request == NULL)
+        {
+            conn->last_request = NULL;
+        }
+        conn->request_count--;
+        recycleBatchRequest(conn, request);
+    }
+}
+
+/*The purpose of this function is to apply the policy of a finished request and to write its reply.
+The results may have been calculated before the words of the previous requests (or of the same request) were added,
+so they are first brought up to date with refreshResult. This way a repeated word that was added
+is PRESENT the second time, exactly like in the telnet dialogue.*/
+void writeBatchReply(Connection *conn, BatchRequest *request)
+{
+    char buffer[BUFFER_SIZE];
+    char output[OUTPUT_CHARACTER_LIMIT + 2];
+    int output_offset = 0;
+
+    if (request->error_message != NULL)
+    {
+        const char *message = request->error_message;
+        while (*message == '\n')
+        {
+            message++;
+        }
+        snprintf(buffer, BUFFER_SIZE, "ERROR %.*s\n", (int)strcspn(message, "\n"), message);
+        sendToClient(conn, buffer);
+        return;
+    }
+    if (request->policy == POLICY_STATS)
+    {
+        char text[4096];
+        int lines = formatStatistics(text, sizeof(text));
+        snprintf(buffer, BUFFER_SIZE, "STATS %d\n", lines);
+        sendToClient(conn, buffer);
+        sendToClient(conn, text);
+        return;
+    }
+
+    snprintf(buffer, BUFFER_SIZE, "OK %d\n", request->word_count);
+    sendToClient(conn, buffer);
+    output[0] = '\0';
+    for (int j = 0; j < request->word_count; j++)
+    {
+        char *word = request->words[j];
+        LevInfo *result = request->tasks[j].result;
+        const char *status;
+        const char *written = word;
+        int offset;
+
+        recordStage(STAGE_ORDER, monotonicNanoseconds() - request->tasks[j].finished);
+        refreshResult(result, word, request->tasks[j].version);
+        if (result[0].diff == 0)
+        {
+            status = "PRESENT";
+        }
+        else if (request->policy == POLICY_ADD)
+        {
+            status = "ADDED";
+            addDictionaryWord(word);
+        }
+        else if (request->policy == POLICY_CORRECT)
+        {
+            status = "CORRECTED";
+            written = dictionaryWord(result[0].word);
+        }
+        else
+        {
+            status = "ABSENT";
+        }
+
+        offset = snprintf(buffer, BUFFER_SIZE, "WORD %s %s", word, status);
+        for (int i = 0; !request->brief && i < LEVENSHTEIN_LIST_LIMIT && result[i].word != NO_WORD && offset < BUFFER_SIZE; i++)
+        {
+            offset += snprintf(buffer + offset, BUFFER_SIZE - offset, " %s %d", dictionaryWord(result[i].word), result[i].diff);
+        }
+        if (offset < BUFFER_SIZE)
+        {
+            snprintf(buffer + offset, BUFFER_SIZE - offset, "\n");
+        }
+        sendToClient(conn, buffer);
+
+        output_offset += snprintf(output + output_offset, OUTPUT_CHARACTER_LIMIT + 2 - output_offset, j == 0 ? "%s" : " %s", written);
+        if (output_offset > OUTPUT_CHARACTER_LIMIT + 1)
+        {
+            output_offset = OUTPUT_CHARACTER_LIMIT + 1;
+        }
+    }
+
+    if (strlen(output) > OUTPUT_CHARACTER_LIMIT)
+    {
+        sendToClient(conn, "ERROR Output exceeds OUTPUT_CHARACTER_LIMIT characters.\n");
+        return;
+    }
+    sendToClient(conn, "OUTPUT ");
+    sendToClient(conn, output);
+    sendToClient(conn, "\n");
+}
+
+/*The purpose of this function is to give a new empty request to the client.
+A request that the client has finished is used again with the blocks of its arena, so a request allocates nothing
+once the client has had as many requests at the same time before.*/
+BatchRequest *newBatchRequest(Connection *conn)
+{
+    BatchRequest *request = conn->spare_requests;
+
+    if (request != NULL)
+    {
+        conn->spare_requests = request->next;
+        request->next = NULL;
+        return request;
+    }
+    request = calloc(1, sizeof(BatchRequest));
+    if (request == NULL)
+    {
+        perror("Error allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    return request;
+}
+
+/*The purpose of this function is to release a written batch request. Its arenas are reset in one step
+and the request is kept by the client for its next request. The document of the request is in its arena,
+so the windows are in an arena of the request too, otherwise their blocks would be freed with every document.*/
+void recycleBatchRequest(Connection *conn, BatchRequest *request)
+{
+    Arena arena = request->arena;
+    Arena window = request->window;
+
+    arenaReset(&arena);
+    arenaReset(&window);
+    memset(request, 0, sizeof(BatchRequest));
+    request->arena = arena;
+    request->window = window;
+    request->next = conn->spare_requests;
+    conn->spare_requests = request;
+}
+
+/*The purpose of this function is to release a batch request and its arenas when the client is released.*/
+void freeBatchRequest(BatchRequest *request)
+{
+    freeArena(&request->arena);
+    freeArena(&request->window);
+    free(request);
+}
+
+// Document Stream Informations
+
+/*The purpose of this function is to tell whether the document of the client can take more bytes:
+its window is not being checked, it is not full, the document has not ended and the client reads its output.*/
+bool documentAcceptsInput(Connection *conn)
+{
+    DocumentStream *document = conn->document;
+    return !document->in_flight && document->length < DOCUMENT_WINDOW_BYTES && document->remaining > 0 &&
+           conn->pending_length - conn->pending_sent <= DOCUMENT_OUTPUT_LIMIT;
+}
+
+/*The purpose of this function is to move the bytes of the document that were received together with the request line
+from the receive buffer into the window. The bytes after the end of the document stay in the receive buffer.*/
+void feedDocument(Connection *conn)
+{
+    DocumentStream *document = conn->document;
+
+    if (documentAcceptsInput(conn) && conn->receive_length > 0)
+    {
+        size_t moved = DOCUMENT_WINDOW_BYTES - document->length;
+        if (moved > document->remaining)
+        {
+            moved = document->remaining;
+        }
+        if (moved > (size_t)conn->receive_length)
+        {
+            moved = conn->receive_length;
+        }
+        size_t first = RECEIVE_BUFFER_SIZE - conn->receive_start;
+        if (first > moved)
+        {
+            first = moved;
+        }
+        memcpy(document->text + document->length, conn->receive_buffer + conn->receive_start, first);
+        memcpy(document->text + document->length + first, conn->receive_buffer, moved - first);
+        document->length += moved;
+        document->remaining -= moved;
+        consumeInput(conn, moved);
+    }
+    if (document->length == DOCUMENT_WINDOW_BYTES || document->remaining == 0)
+    {
+        dispatchDocument(conn, false);
+    }
+}
+
+/*The purpose of this function is to give the words of the window to the thread pool.
+If the document continues, the letters at the end of the window may be the beginning of a word, they wait for the next window.
+pause is true when the window is not full but the client sends nothing at the moment; if the window holds only the beginning
+of a word then, nothing is done. A word longer than INPUT_CHARACTER_LIMIT is not a word of the project and is written as it is,
+also when it does not fit in one window: its letters at the beginning of the next windows are skipped until the first other character.*/
+void dispatchDocument(Connection *conn, bool pause)
+{
+    DocumentStream *document = conn->document;
+    size_t cut = document->length;
+
+    if (document->in_flight || (pause && document->length == 0))
+    {
+        return;
+    }
+    if (document->remaining > 0)
+    {
+        while (cut > 0 && isalpha((unsigned char)document->text[cut - 1]))
+        {
+            cut--;
+        }
+        if (cut == 0 && (pause || document->length < DOCUMENT_WINDOW_BYTES))
+        {
+            return;
+        }
+        if (cut == 0)
+        {
+            cut = document->length; // the whole window is one very long word
+        }
+    }
+    size_t first = 0;
+    if (document->skipping_long_word)
+    {
+        while (first < cut && isalpha((unsigned char)document->text[first]))
+        {
+            first++;
+        }
+    }
+    document->skipping_long_word = document->remaining > 0 && cut == document->length && isalpha((unsigned char)document->text[cut - 1]);
+
+    uint64_t start = monotonicNanoseconds();
+    int capacity = cut / 2 + 1;
+    document->starts = arenaAlloc(document->window, capacity * sizeof(int));
+    document->words = arenaAlloc(document->window, cut + capacity);
+    document->tasks = arenaCalloc(document->window, capacity, sizeof(ThreadData));
+    document->cut = cut;
+    document->word_count = 0;
+    size_t offset = 0;
+    for (size_t i = first; i < cut;)
+    {
+        if (!isalpha((unsigned char)document->text[i]))
+        {
+            i++;
+            continue;
+        }
+        size_t end = i;
+        while (end < cut && isalpha((unsigned char)document->text[end]))
+        {
+            end++;
+        }
+        if (end - i <= INPUT_CHARACTER_LIMIT)
+        {
+            ThreadData *data = &document->tasks[document->word_count];
+            document->starts[document->word_count] = i;
+            data->word = document->words + offset;
+            for (size_t j = i; j < end; j++)
+            {
+                document->words[offset++] = tolower((unsigned char)document->text[j]);
+            }
+            document->words[offset++] = '\0';
+            data->id = ++document->word_count;
+            data->conn = conn;
+            data->matches = MATCHES_UNKNOWN; // the closest words are only needed for the words that are replaced
+        }
+        i = end;
+    }
+    recordStage(STAGE_SPLIT, monotonicNanoseconds() - start);
+
+    document->in_flight = true;
+    pthread_mutex_lock(&conn->completion_mutex);
+    conn->outstanding += document->word_count;
+    pthread_mutex_unlock(&conn->completion_mutex);
+    for (int j = 0; j < document->word_count; j++)
+    {
+        document->tasks[j].submitted = monotonicNanoseconds();
+        submitTask(&pool, threadFunction, &document->tasks[j]);
+    }
+    if (document->word_count == 0)
+    {
+        processBatch(conn); // nothing will complete, the window can be written now
+    }
+}
+
+/*The purpose of this function is to continue the document that is the oldest request of the client.
+The checked window is written when all its words are finished, and when the whole document has been written, END is written.
+Returns true if the document has ended and the request can be released.*/
+bool continueDocument(Connection *conn, BatchRequest *request)
+{
+    DocumentStream *document = request->document;
+    char buffer[BUFFER_SIZE];
+
+    if (request->error_message != NULL)
+    {
+        writeBatchReply(conn, request);
+        return true;
+    }
+    if (document->in_flight)
+    {
+        bool finished = true;
+        pthread_mutex_lock(&conn->completion_mutex);
+        for (int j = 0; j < document->word_count; j++)
+        {
+            if (!document->tasks[j].done)
+            {
+                finished = false;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&conn->completion_mutex);
+        if (!finished)
+        {
+            return false;
+        }
+        writeDocumentWindow(conn, document);
+        if (document->remaining > 0 || document->length > 0)
+        {
+            feedDocument(conn); // the bytes that were received while the window was checked
+        }
+    }
+    if (document->remaining > 0 || document->length > 0 || document->in_flight)
+    {
+        return false;
+    }
+    snprintf(buffer, BUFFER_SIZE, "END %lu %lu\n", document->total_words, document->corrected_words);
+    sendToClient(conn, buffer);
+    if (conn->document == document)
+    {
+        conn->document = NULL;
+    }
+    return true;
+}
+
+/*The purpose of this function is to write the checked part of the window as one CHUNK and to keep the rest of the window.
+A word that is not in the dictionary is replaced by its closest word, with a capital first letter if the word had one
+and in capital letters if the word was written in capital letters.*/
+void writeDocumentWindow(Connection *conn, DocumentStream *document)
+{
+    char buffer[BUFFER_SIZE];
+    size_t size = document->cut;
+    const char **replacements = arenaAlloc(document->window, (document->word_count + 1) * sizeof(char *));
+
+    for (int j = 0; j < document->word_count; j++)
+    {
+        ThreadData *data = &document->tasks[j];
+        LevInfo *result = data->result;
+        recordStage(STAGE_ORDER, monotonicNanoseconds() - data->finished);
+        refreshResult(result, data->word, data->version);
+        replacements[j] = NULL;
+        if (result[0].diff != 0 && result[0].word != NO_WORD)
+        {
+            replacements[j] = dictionaryWord(result[0].word);
+            size += strlen(replacements[j]) - strlen(data->word);
+            document->corrected_words++;
+        }
+    }
+    document->total_words += document->word_count;
+
+    snprintf(buffer, BUFFER_SIZE, "CHUNK %zu\n", size);
+    sendToClient(conn, buffer);
+    size_t written = 0;
+    for (int j = 0; j < document->word_count; j++)
+    {
+        if (replacements[j] == NULL)
+        {
+            continue;
+        }
+        size_t start = document->starts[j];
+        size_t length = strlen(document->tasks[j].word);
+        char word[INPUT_CHARACTER_LIMIT + 1];
+        snprintf(word, sizeof(word), "%s", replacements[j]);
+        bool capitals = length > 1;
+        for (size_t i = 0; capitals && i < length; i++)
+        {
+            capitals = isupper((unsigned char)document->text[start + i]);
+        }
+        for (size_t i = 0; word[i] != '\0' && (i == 0 || capitals); i++)
+        {
+            if (isupper((unsigned char)document->text[start]))
+            {
+                word[i] = toupper((unsigned char)word[i]);
+            }
+        }
+        sendBytesToClient(conn, document->text + written, start - written);
+        sendToClient(conn, word);
+        written = start + length;
+    }
+    sendBytesToClient(conn, document->text + written, document->cut - written);
+
+    arenaReset(document->window);
+    document->tasks = NULL;
+    document->starts = NULL;
+    document->words = NULL;
+    document->word_count = 0;
+    memmove(document->text, document->text + document->cut, document->length - document->cut);
+    document->length -= document->cut;
+    document->cut = 0;
+    document->in_flight = false;
+}
+
+/*The purpose of this function is to bring a result calculated with an older dictionary up to date.
+Adding a word w to the dictionary can change the closest words of another word only by putting w itself into the list,
+because the differences of all the other dictionary words stay the same. So for every word added after the result was calculated,
+its difference is calculated and it is inserted into the list if it is close enough.
+The words added after the result was calculated are the words from version to the end of the dictionary.
+The event loop always sees the newest version. The workers call it for the results of the cache
+and bring them up to the version that they read.*/
+void refreshResult(LevInfo *result, const char *word, uint32_t version)
+{
+    int length = strlen(word);
+    uint32_t count = dictionaryVersion()->count;
+    for (uint32_t v = version; v < count; v++)
+    {
+        LevInfo candidate;
+        int position = LEVENSHTEIN_LIST_LIMIT - 1;
+
+        candidate.word = v;
+        candidate.diff = levenshteinDistance(word, length, dictionaryWord(v), dictionaryLength(v));
+        if (compareLevInfo(&candidate, &result[position]) >= 0)
+        {
+            continue;
+        }
+        while (position > 0 && compareLevInfo(&candidate, &result[position - 1]) < 0)
+        {
+            result[position] = result[position - 1];
+            position--;
+        }
+        result[position] = candidate;
+    }
+}
+
+/*The purpose of this function is to greet a new client and to ask for the first input.*/
+void startSession(Connection *conn)
+{
+    sendToClient(conn, "\n\nHello, this is Text Analysis Server!\n");
+    sendToClient(conn, "\nPlease enter your input string:\n");
+    conn->state = SESSION_AWAIT_INPUT;
+}
+
+/*The purpose of this function is to continue the session of the client with the line it has just sent.
+The state of the session decides what the line is an answer to.*/
+void handleLine(Connection *conn, char *line)
+{
+    switch (conn->state)
+    {
+    case SESSION_AWAIT_INPUT:
+        /*STATS in capital letters is not a sentence but a question of the operator, the session continues after the answer.*/
+        if (strcmp(line, "STATS") == 0)
+        {
+            char text[4096];
+            formatStatistics(text, sizeof(text));
+            sendToClient(conn, "\n");
+            sendToClient(conn, text);
+            sendToClient(conn, "\nPlease enter your input string:\n");
+            break;
+        }
+        startSentence(conn, line);
+        break;
+    case SESSION_AWAIT_CONFIRM:
+        answerWord(conn, line);
+        break;
+    case SESSION_AWAIT_AGAIN:
+        /*The user can choose whether or not to enter another input.*/
+        toLowerCase(line);
+        if (strcmp(line, "y") != 0)
+        {
+            sendToClient(conn, "\nNo other input will be received");
+            endSession(conn);
+            break;
+        }
+        clearScreen(conn);
+        sendToClient(conn, "\nPlease enter your input string:\n");
+        conn->state = SESSION_AWAIT_INPUT;
+        break;
+    case SESSION_SCORING:
+    case SESSION_BATCH:
+    case SESSION_CLOSING:
+        break;
+    }
+}
+
+/*The purpose of this function is to say Good Bye to the client. The connection is closed by the event loop
+after this message has been written completely.*/
+void endSession(Connection *conn)
+{
+    sendToClient(conn, "\n\nThank you for using Text Analysis Server! Good Bye!\n\n");
+    freeSentence(conn);
+    conn->state = SESSION_CLOSING;
+}
+
+/*If the file process is completed successfully and no errors are found, the user enters an input in the next step.
+The input entered by the user cannot be as desired in this code. In certain cases, messages are sent indicating that the input is incorrect.*/
+/*If the error_message of the connection is set, then the user has made one of the error conditions and in this case the code
+says Good Bye to the client and closes its connection. Other clients are not affected.*/
+void startSentence(Connection *conn, char *input)
+{
+    if (conn->error_message != NULL)
+    {
+        sendToClient(conn, conn->error_message);
+        endSession(conn);
+        return;
+    }
+
+    /*If there is no contrary situation in the input phase, the code fragment will continue and ask the user one last question,
+    even if an error occurs in any other case in the remaining designed code
+    (output specified in the project document or input cases related to the dictionary, etc.).*/
+    conn->input = arenaCopy(&conn->arena, input, strlen(input));
+    conn->counter = 1; // this variable will be used later, its main purpose is to determine the order of the words.
+
+    // Split words
+    uint64_t start = monotonicNanoseconds();
+    splitSentence(conn, input);
+    recordStage(STAGE_SPLIT, monotonicNanoseconds() - start);
+
+    /*If there is no contrary situation after the array process is completed, the user can now be given the answer respectively.*/
+    /*The reason why the size of the output string is 2 more than the output_limit is the following.
+    snprintf, which will be used in the future, detects the characters in the specified buffer size even if you write as many characters as you want
+    (for write operation).For example, if you write 201 in the buffer size,
+    snprintf 200 detects at most 200 characters and puts a null terminator in the last character.
+    The reason why it is 2 more than Output_Limit is to give +1 error condition (to give 201 character error in this code fragment equal to output_limit 200).*/
+    conn->Output_String = (char *)arenaAlloc(&conn->arena, (OUTPUT_CHARACTER_LIMIT + 2) * sizeof(char));
+    conn->Output_String[0] = '\0';
+    conn->output_offset = 0; // offset is an integer variable used to print side by side with snprintf
+
+    conn->position = 0;
+    startWords(conn);
+    processWords(conn);
+}
+
+/*The words created by splitSentence are started here. Before, the sentence was cut into groups at every repeated word
+and a group was started only when the one before it was written, because a word that the user adds to the dictionary
+must be seen by the Levenshtein calculation of the same word later in the sentence.
+Now every different word is given to the thread pool once, all at the same time, and only a repeated word waits:
+it is scheduled when the previous occurrence of the same word has been written (scheduleRepeat).
+There is no join for the sentence: the workers mark the words done in any order and processWords writes them in order.*/
+void startWords(Connection *conn)
+{
+    conn->tasks = arenaCalloc(&conn->arena, conn->word_count, sizeof(ThreadData));
+    for (int j = 0; j < conn->word_count; j++)
+    {
+        if (conn->repeat_of[j] < 0)
+        {
+            submitWord(conn, j);
+        }
+    }
+}
+
+/*The purpose of this function is to give the word at the position to the thread pool.*/
+void submitWord(Connection *conn, int position)
+{
+    ThreadData *data = &conn->tasks[position];
+
+    data->word = conn->words[position];
+    data->id = position + 1;
+    data->conn = conn;
+    data->done = false;
+    data->matches = known_word_matches ? MATCHES_ALWAYS : MATCHES_UNKNOWN;
+    pthread_mutex_lock(&conn->completion_mutex);
+    conn->outstanding++;
+    pthread_mutex_unlock(&conn->completion_mutex);
+    // Give a task for the word to compare against the dictionary
+    data->submitted = monotonicNanoseconds();
+    submitTask(&pool, threadFunction, data);
+}
+
+/*The purpose of this function is to give a result to a repeated word when its previous occurrence has been written.
+If the user added the previous occurrence, the word has to be searched again, because the dictionary has changed for it;
+the session waits for this search only. Otherwise the result of the previous occurrence is copied without any search.
+The words that other positions added in the meantime are put into it with refreshResult, exactly as a new search would find them.
+A result that only says that the word is present (MATCHES_UNKNOWN) does not change when other words are added.
+Returns true if the result is ready.*/
+bool scheduleRepeat(Connection *conn, int position)
+{
+    ThreadData *data = &conn->tasks[position];
+    int previous = conn->repeat_of[position];
+
+    if (data->conn != NULL)
+    {
+        return true; // already scheduled
+    }
+    if (conn->added[previous])
+    {
+        submitWord(conn, position);
+        return false;
+    }
+    *data = conn->tasks[previous];
+    data->id = position + 1;
+    data->word = conn->words[position];
+    data->finished = monotonicNanoseconds();
+    if (data->matches == MATCHES_ALWAYS || data->result[0].diff != 0)
+    {
+        refreshResult(data->result, data->word, data->version);
+        data->version = dictionaryVersion()->count;
+    }
+    return true;
+}
+
+// Arena Informations
+
+/*The purpose of this function is to take size bytes from the arena. The memory is aligned for every type and it is not cleared.
+When the current block is full, the next block that was kept by arenaReset is used, and only when there is none
+a new block is allocated (at least ARENA_BLOCK_SIZE bytes, or exactly as large as a larger allocation).*/
+void *arenaAlloc(Arena *arena, size_t size)
+{
+    ArenaBlock *block = arena->current;
+
+    size = (size + sizeof(max_align_t) - 1) / sizeof(max_align_t) * sizeof(max_align_t);
+    while (block != NULL && block->used + size > block->size)
+    {
+        if (block->next == NULL)
+        {
+            break;
+        }
+        block = block->next;
+        block->used = 0;
+    }
+    if (block == NULL || block->used + size > block->size)
+    {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        ArenaBlock *added = malloc(sizeof(ArenaBlock) + block_size);
+        if (added == NULL)
+        {
+            perror("Error allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        added->next = NULL;
+        added->size = block_size;
+        added->used = 0;
+        if (block == NULL)
+        {
+            arena->first = added;
+        }
+        else
+        {
+            block->next = added;
+        }
+        block = added;
+    }
+    arena->current = block;
+    void *pointer = (char *)block->data + block->used;
+    block->used += size;
+    return pointer;
+}
+
+/*The same as arenaAlloc for count elements of size bytes, cleared like calloc does.*/
+void *arenaCalloc(Arena *arena, size_t count, size_t size)
+{
+    void *pointer = arenaAlloc(arena, count * size);
+    memset(pointer, 0, count * size);
+    return pointer;
+}
+
+/*The purpose of this function is to copy length characters of text into the arena as a string.*/
+char *arenaCopy(Arena *arena, const char *text, size_t length)
+{
+    char *copy = arenaAlloc(arena, length + 1);
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+/*The purpose of this function is to release everything allocated from the arena at once. The blocks are kept for the next allocations.*/
+void arenaReset(Arena *arena)
+{
+    arena->current = arena->first;
+    if (arena->first != NULL)
+    {
+        arena->first->used = 0;
+    }
+}
+
+/*The purpose of this function is to give the blocks of the arena back to the heap.*/
+void freeArena(Arena *arena)
+{
+    ArenaBlock *block = arena->first;
+    while (block != NULL)
+    {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->first = NULL;
+    arena->current = NULL;
+}
+
+// Thread Function Informations
+
+/*This is the task that the workers of the thread pool run for every word.
+Regardless of the number of words sent, Levenshtein values ​​are calculated at the same time and the result is written into the ThreadData of the word.
+The workers do not write anything to the socket. Writing the answers in order and asking the user is done by processWords,
+so no worker has to wait for its turn or for the answer of a user.
+If the closest words are not needed, the membership of the word is answered by the WordSet without any calculation.
+A word that was calculated before is taken from the result cache instead.*/
+void *threadFunction(void *arg)
+{
+    ThreadData *data = (ThreadData *)arg;
+    uint64_t start = monotonicNanoseconds();
+
+    recordStage(STAGE_QUEUE, start - data->submitted);
+    readDictionary();
+    data->version = reader_version->count;
+    if (data->matches != MATCHES_ALWAYS)
+    {
+        uint32_t index = findWord(data->word);
+        if (index != NO_WORD || data->matches == MATCHES_NEVER)
+        {
+            membershipResult(index, data->result);
+            finishReading();
+            recordStage(STAGE_SEARCH, monotonicNanoseconds() - start);
+            completeWord(data);
+            return NULL;
+        }
+    }
+
+    if (!cacheLookup(data->word, &data->version, data->result))
+    {
+        calculateLevenshtein(data->word, data->result);
+        cacheStore(data->word, data->version, data->result);
+    }
+    finishReading();
+    recordStage(STAGE_SEARCH, monotonicNanoseconds() - start);
+    completeWord(data);
+    return NULL;
+}
+
+/*The purpose of this function is to put the result of a word into the completion queue of its session.
+The session is put on the ready list only once, however many of its words finish before the event loop sees it,
+and the event loop is woken up only when the list was empty.*/
+void completeWord(ThreadData *data)
+{
+    Connection *conn = data->conn;
+    bool queue;
+
+    data->finished = monotonicNanoseconds();
+    pthread_mutex_lock(&conn->completion_mutex);
+    data->done = true;
+    conn->outstanding--;
+    queue = !conn->in_ready_list;
+    conn->in_ready_list = true;
+    pthread_mutex_unlock(&conn->completion_mutex);
+
+    if (queue)
+    {
+        bool wake;
+        pthread_mutex_lock(&ready_mutex);
+        wake = ready_sessions == NULL;
+        conn->next_ready = ready_sessions;
+        ready_sessions = conn;
+        pthread_mutex_unlock(&ready_mutex);
+        if (wake)
+        {
+            uint64_t one = 1;
+            if (write(wakeup_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            {
+                perror("eventfd write failed");
+            }
+        }
+    }
+}
+
+/*The purpose of this function is to write the finished words of every session on the ready list.
+It runs in the event loop, so it is the only one that writes to the clients.
+A closed session whose last task has finished is released here.*/
+void drainReadySessions(void)
+{
+    uint64_t count;
+    Connection *list;
+
+    if (read(wakeup_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+    {
+        perror("eventfd read failed");
+    }
+    pthread_mutex_lock(&ready_mutex);
+    list = ready_sessions;
+    ready_sessions = NULL;
+    pthread_mutex_unlock(&ready_mutex);
+
+    while (list != NULL)
+    {
+        Connection *conn = list;
+        bool closed;
+        int outstanding;
+        list = conn->next_ready;
+
+        pthread_mutex_lock(&conn->completion_mutex);
+        conn->in_ready_list = false;
+        closed = conn->closed;
+        outstanding = conn->outstanding;
+        pthread_mutex_unlock(&conn->completion_mutex);
+
+        if (closed)
+        {
+            if (outstanding == 0)
+            {
+                releaseConnection(conn);
+            }
+            continue;
+        }
+        if (conn->state == SESSION_SCORING)
+        {
+            processWords(conn);
+            processInput(conn); // the lines that arrived while the session was scoring
+            finishEvents(conn);
+        }
+        else if (conn->state == SESSION_BATCH)
+        {
+            processBatch(conn);
+            processInput(conn); // the requests that were not read while too many were in flight
+            finishEvents(conn);
+        }
+    }
+}
+
+// Thread Pool Informations
+
+/*The purpose of this function is to create the workers of the pool and their deques.
+Returns 0 on success and -1 if the memory or the threads could not be created.*/
+int createThreadPool(ThreadPool *pool, int size)
+{
+    memset(pool, 0, sizeof(ThreadPool));
+    pool->size = size;
+    pool->threads = calloc(size, sizeof(pthread_t));
+    pool->deques = calloc(size, sizeof(WorkDeque));
+    if (pool->threads == NULL || pool->deques == NULL)
+    {
+        return -1;
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    for (int i = 0; i < size; i++)
+    {
+        pthread_mutex_init(&pool->deques[i].mutex, NULL);
+        pool->deques[i].capacity = 16;
+        pool->deques[i].tasks = malloc(pool->deques[i].capacity * sizeof(Task));
+        if (pool->deques[i].tasks == NULL)
+        {
+            return -1;
+        }
+    }
+    for (int i = 0; i < size; i++)
+    {
+        if (pthread_create(&pool->threads[i], NULL, workerFunction, (void *)(intptr_t)i) != 0)
+        {
+            pool->size = i; // only the created workers are stopped by destroyThreadPool
+            destroyThreadPool(pool);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*The purpose of this function is to stop the workers after they have run all remaining tasks, and to release the pool.*/
+void destroyThreadPool(ThreadPool *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 0; i < pool->size; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (int i = 0; i < pool->size; i++)
+    {
+        pthread_mutex_destroy(&pool->deques[i].mutex);
+        free(pool->deques[i].tasks);
+    }
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->cond);
+    free(pool->deques);
+    free(pool->threads);
+}
+
+/*The purpose of this function is to give a task to the pool. A worker puts its new tasks into its own deque,
+the event loop gives them to the deques in turn. A sleeping worker is woken up if there is one.
+The result of the task is given through arg, its return value is not used.*/
+void submitTask(ThreadPool *pool, void *(*function)(void *), void *arg)
+{
+    int index = worker_index >= 0 ? worker_index : (int)(pool->next_deque++ % pool->size);
+    WorkDeque *deque = &pool->deques[index];
+
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->count == deque->capacity)
+    {
+        // The circular array is full, it is doubled and the tasks are put in order from the beginning.
+        Task *temp = malloc(deque->capacity * 2 * sizeof(Task));
+        if (temp == NULL)
+        {
+            perror("Error allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < deque->count; i++)
+        {
+            temp[i] = deque->tasks[(deque->head + i) % deque->capacity];
+        }
+        free(deque->tasks);
+        deque->tasks = temp;
+        deque->head = 0;
+        deque->capacity *= 2;
+    }
+    Task *task = &deque->tasks[(deque->head + deque->count) % deque->capacity];
+    task->function = function;
+    task->arg = arg;
+    deque->count++;
+    pthread_mutex_unlock(&deque->mutex);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->pending++;
+    if (pool->sleeping > 0)
+    {
+        pthread_cond_signal(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/*The purpose of this function is to find a task for the worker index: first the newest task of its own deque,
+then the oldest task of the other deques. Returns false if all deques are empty.*/
+bool takeTask(ThreadPool *pool, int index, Task *task)
+{
+    for (int i = 0; i < pool->size; i++)
+    {
+        WorkDeque *deque = &pool->deques[(index + i) % pool->size];
+        bool taken = false;
+
+        pthread_mutex_lock(&deque->mutex);
+        if (deque->count > 0)
+        {
+            if (i == 0)
+            {
+                *task = deque->tasks[(deque->head + deque->count - 1) % deque->capacity]; // own deque: bottom
+            }
+            else
+            {
+                *task = deque->tasks[deque->head]; // steal: top
+                deque->head = (deque->head + 1) % deque->capacity;
+            }
+            deque->count--;
+            taken = true;
+        }
+        pthread_mutex_unlock(&deque->mutex);
+
+        if (taken)
+        {
+            pthread_mutex_lock(&pool->mutex);
+            pool->pending--;
+            pthread_mutex_unlock(&pool->mutex);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*Run a task.*/
+void runTask(Task *task)
+{
+    task->function(task->arg);
+}
+
+/*This is the function of every worker thread. The worker runs tasks while there are any,
+and sleeps on the condition variable of the pool when all deques are empty.*/
+void *workerFunction(void *arg)
+{
+    Task task;
+    worker_index = (int)(intptr_t)arg;
+    thread_statistics = worker_index + 1 < statistics_count ? &statistics[worker_index + 1] : NULL;
+
+    while (true)
+    {
+        if (takeTask(&pool, worker_index, &task))
+        {
+            runTask(&task);
+            continue;
+        }
+        pthread_mutex_lock(&pool.mutex);
+        while (pool.pending == 0 && !pool.stopping)
+        {
+            pool.sleeping++;
+            pthread_cond_wait(&pool.cond, &pool.mutex);
+            pool.sleeping--;
+        }
+        bool stop = pool.stopping && pool.pending == 0;
+        pthread_mutex_unlock(&pool.mutex);
+        if (stop)
+        {
+            break;
+        }
+    }
+    freeArena(&scratch_arena);
+    return NULL;
+}
+
+/*The response information of the elements entered in order is printed in a way that it will be the same as the given document.
+The snprintf structure is very important here. Whether or not each word written by the user is in the dictionary is done by looking
+at the first element of the array formed by the Levensthein function. As stated above, if the user has entered the input correctly,
+no matter what happens, the user is asked again if they enter a wrong word (do you want to add it to the dictionary).
+When the user has to be asked, the function returns to the event loop and answerWord continues from the same word.*/
+void processWords(Connection *conn)
+{
+    // The buffer required to print the specified text outside the output string.
+    char buffer[BUFFER_SIZE];
+
+    while (conn->position < conn->word_count)
+    {
+        char *word = conn->words[conn->position];
+        ThreadData *data = &conn->tasks[conn->position];
+        LevInfo *result;
+        int offset = 0;
+
+        if (conn->repeat_of[conn->position] >= 0 && !scheduleRepeat(conn, conn->position))
+        {
+            conn->state = SESSION_SCORING;
+            return;
+        }
+        pthread_mutex_lock(&conn->completion_mutex);
+        result = data->done ? data->result : NULL;
+        pthread_mutex_unlock(&conn->completion_mutex);
+        if (result == NULL)
+        {
+            /*The next word is not finished yet. The words after it may be finished, but they are written in order,
+            so the session waits without blocking the event loop until completeWord puts it on the ready list.*/
+            conn->state = SESSION_SCORING;
+            return;
+        }
+        recordStage(STAGE_ORDER, monotonicNanoseconds() - data->finished);
+        /*The word was searched when the sentence arrived, the words that the user has added since then are put into its result,
+        so it is the same as if the word had been searched after the answers of the user.*/
+        if (data->matches == MATCHES_ALWAYS || result[0].diff != 0)
+        {
+            refreshResult(result, word, data->version);
+            data->version = dictionaryVersion()->count;
+        }
+
+        snprintf(buffer, BUFFER_SIZE, "\nWORD %02d: %s\n", conn->counter, word);
+        sendToClient(conn, buffer);
+
+        offset += snprintf(buffer + offset, BUFFER_SIZE - offset, "MATCHES: ");
+        for (int i = 0; i < LEVENSHTEIN_LIST_LIMIT && (i == 0 || result[i].word != NO_WORD); i++)
+        {
+            // Let's add a comma before the next element, but not before the first element
+            if (i > 0)
+            {
+                offset += snprintf(buffer + offset, BUFFER_SIZE - offset, ", ");
+            }
+
+            // Print each element (word and diff)
+            offset += snprintf(buffer + offset, BUFFER_SIZE - offset, "%s (%d)", dictionaryWord(result[i].word), result[i].diff);
+        }
+        offset += snprintf(buffer + offset, BUFFER_SIZE - offset, "\n");
+        sendToClient(conn, buffer);
+
+        // check dictionary situation
+        /*If the word is in the dictionary, it is written directly to the output as it is.
+        If the word is not in the dictionary, the user is asked and the session waits for the answer.*/
+        if (result[0].diff == 0)
+        {
+            snprintf(buffer, 132, "WORD %s is present in dictionary\n", word);
+            sendToClient(conn, buffer);
+            MakeOutputString(conn, conn->counter, word);
+            conn->position++;
+            conn->counter++;
+            continue;
+        }
+
+        snprintf(buffer, 136, "WORD %s is not present in dictionary\n", word);
+        sendToClient(conn, buffer);
+        sendToClient(conn, "Do you want to add this word to dictionary? (y/N):");
+        conn->state = SESSION_AWAIT_CONFIRM;
+        return;
+    }
+    finishSentence(conn);
+}
+
+/*The purpose of this function is to use the answer of the user for a word that is not in the dictionary.
+If the user adds the word, the word is added to the dictionary and written to the output string as it is.
+If the user does not want it, the closest word to it is added to the output string.
+The process continues until y\n or empty response is received.*/
+void answerWord(Connection *conn, const char *answer)
+{
+    char *word = conn->words[conn->position];
+    LevInfo *result = conn->tasks[conn->position].result; // already written, so it is done
+    char input[INPUT_CHARACTER_LIMIT + 3];
+
+    snprintf(input, sizeof(input), "%s", answer);
+    toLowerCase(input);
+    if (strlen(input) == 0 || strcmp(input, "n") == 0)
+    {
+        MakeOutputString(conn, conn->counter, dictionaryWord(result[0].word));
+    }
+    else if (strcmp(input, "y") == 0)
+    {
+        MakeOutputString(conn, conn->counter, word);
+        addDictionaryWord(word);
+        conn->added[conn->position] = true;
+    }
+    else
+    {
+        sendToClient(conn, "Wrong Input Please Enter Again (y/N):");
+        return;
+    }
+
+    conn->state = SESSION_AWAIT_INPUT;
+    conn->position++;
+    conn->counter++;
+    processWords(conn);
+}
+
+/*After the user sees the Levensthein answers and the dictionary possibilities,
+the input and output answers are written to the screen. If the limit is exceeded,
+an error is printed and the user cannot add the words to the dictionary even if he wants to.
+The words that the user added are already in the log of the dictionary, the flusher thread writes them to the disk.*/
+void finishSentence(Connection *conn)
+{
+    toLowerCase(conn->input);
+    sendToClient(conn, "\nINPUT: ");
+    sendToClient(conn, conn->input);
+    if (strlen(conn->Output_String) > OUTPUT_CHARACTER_LIMIT)
+    {
+        sendToClient(conn, "\nError: Ouput exceeds OUTPUT_CHARACTER_LIMIT characters.");
+    }
+    else
+    {
+        sendToClient(conn, "\nOUTPUT: ");
+        sendToClient(conn, conn->Output_String);
+    }
+    freeSentence(conn);
+
+    sendToClient(conn, "\n\nWould you like to enter another input?(y|Y):");
+    conn->state = SESSION_AWAIT_AGAIN;
+}
+
+/*The purpose of this function is to release everything that belongs to the sentence of the client.
+All of it is in the arena of the client, so it is released in one step and the memory is used again by the next sentence.
+It is only called when no word of the sentence is being calculated any more.
+It is safe to call it more than once and in every state of the session.*/
+void freeSentence(Connection *conn)
+{
+    arenaReset(&conn->arena);
+    conn->tasks = NULL;
+    conn->split_text = NULL;
+    conn->words = NULL;
+    conn->repeat_of = NULL;
+    conn->added = NULL;
+    conn->word_count = 0;
+    conn->Output_String = NULL;
+    conn->input = NULL;
+}
+
+/*The purpose of this function is to create the output properly.
+The reason for writing Output_character_limit+2 is stated above. (To provide the max character requirement as min.)*/
+void MakeOutputString(Connection *conn, int thread_id, const char *word)
+{
+    if (thread_id == 1)
+    {
+        conn->output_offset += snprintf(conn->Output_String + conn->output_offset, OUTPUT_CHARACTER_LIMIT + 2 - conn->output_offset, "%s", word);
+    }
+    else
+    {
+        conn->output_offset += snprintf(conn->Output_String + conn->output_offset, OUTPUT_CHARACTER_LIMIT + 2 - conn->output_offset, " %s", word);
+    }
+    /*snprintf returns the length it would have written, so the offset is kept inside the buffer.
+    One character over the limit is enough for the error check of the output.*/
+    if (conn->output_offset > OUTPUT_CHARACTER_LIMIT + 1)
+    {
+        conn->output_offset = OUTPUT_CHARACTER_LIMIT + 1;
+    }
+}
+
+/*The purpose of the calculateLevenshtein function is to find the closest dictionary words of a word entered by the user.
+The function calculates the difference between two words (character differences) with levenshteinDistance.
+For example, if two words are identical, the difference will be 0. On the other hand, for an example like "hello" and "hollow," the difference will be 2.
+The result is an array for the following reason: it selects the top matches based on the specified limit.
+The array holds up to the limit number of words and their corresponding differences with any word
+in the user's input sentence. It is given by the caller (the task of the word), so the search allocates no memory for it.
+The words are searched in the BK-tree of the dictionary, so only a small part of the dictionary is compared with the word.
+The full scan below is still used when the tree is empty and it gives exactly the same answer.
+When the symmetric delete index is used, it is asked first; only the words that have less than LEVENSHTEIN_LIST_LIMIT
+dictionary words within symspell_distance go on to the tree or the scan.*/
+void calculateLevenshtein(const char *s1, LevInfo *result)
+{
+    if (symspell_distance > 0 && searchDeletes(s1, result))
+    {
+        return;
+    }
+    if (use_bk_tree && bk_root != NULL)
+    {
+        searchBKTree(bk_root, s1, result);
+        return;
+    }
+    scanDictionary(s1, result);
+}
+
+/*This is the first version of calculateLevenshtein. It compares each word entered by the user with every word in the dictionary.
+Instead of keeping the difference of every dictionary word, only the best LEVENSHTEIN_LIST_LIMIT words are kept in a small heap,
+and the difference of the worst of them is the threshold: the calculation of a word stops as soon as it can not be better (boundedLevenshtein).
+The words of the dictionary file are visited by length, starting with the length of s1, so the loop ends as soon as
+the length difference is more than the threshold, and every length is one piece of the arena that is read from the beginning to the end.
+The words added after that are checked one by one with their lengths.
+The memory used for a word is the heap of LEVENSHTEIN_LIST_LIMIT elements, whatever the size of the dictionary is.
+A large dictionary file is scanned by all workers together (scanParallel), the answer is the same.*/
+void scanDictionary(const char *s1, LevInfo *result)
+{
+    int len1 = strlen(s1);
+    int found = 0;
+    LevInfo heap[LEVENSHTEIN_LIST_LIMIT];
+
+    if (dict.base_count >= PARALLEL_SCAN_WORDS && pool.size > 1)
+    {
+        scanParallel(s1, len1, heap, &found);
+    }
+    else
+    {
+        for (int d = 0; d <= INPUT_CHARACTER_LIMIT && d <= topThreshold(heap, found); d++)
+        {
+            for (int side = 0; side < (d == 0 ? 1 : 2); side++)
+            {
+                int len2 = side == 0 ? len1 + d : len1 - d;
+                if (len2 < 0 || len2 > INPUT_CHARACTER_LIMIT)
+                {
+                    continue;
+                }
+                for (uint32_t m = dict.buckets[len2]; m < dict.buckets[len2 + 1]; m++)
+                {
+                    int threshold = topThreshold(heap, found);
+                    int diff = boundedLevenshtein(s1, len1, dict.base_characters + dict.base_offsets[m], len2, threshold);
+                    if (diff <= threshold)
+                    {
+                        pushTopWord(heap, &found, m, diff);
+                    }
+                }
+            }
+        }
+    }
+    uint32_t count = dictionaryVersion()->count;
+    for (uint32_t m = dict.base_count; m < count; m++)
+    {
+        int len2 = dictionaryLength(m);
+        int threshold = topThreshold(heap, found);
+        if (abs(len1 - len2) > threshold)
+        {
+            continue;
+        }
+        int diff = boundedLevenshtein(s1, len1, dictionaryWord(m), len2, threshold);
+        if (diff <= threshold)
+        {
+            pushTopWord(heap, &found, m, diff);
+        }
+    }
+    /*The desired situation in the project document is to return the number of words and the differences of those words with
+    a certain limit and the closest limit number. so an extra function was used.*/
+    TopWords(heap, found, result);
+}
+
+/*The purpose of this function is to calculate the Levenshtein difference of two words with the classic dynamic programming table.
+dp[i][j] is the difference between the first i characters of s1 and the first j characters of s2.*/
+int levenshteinDistance(const char *s1, int len1, const char *s2, int len2)
+{
+    int dp[len1 + 1][len2 + 1];
+
+    for (int i = 0; i <= len1; i++)
+        dp[i][0] = i;
+    for (int j = 0; j <= len2; j++)
+        dp[0][j] = j;
+
+    for (int i = 1; i <= len1; i++)
+    {
+        for (int j = 1; j <= len2; j++)
+        {
+            int cost = (s1[i - 1] == s2[j - 1]) ? 0 : 1;
+            dp[i][j] = dp[i - 1][j - 1] + cost;
+            if (dp[i - 1][j] + 1 < dp[i][j])
+                dp[i][j] = dp[i - 1][j] + 1;
+            if (dp[i][j - 1] + 1 < dp[i][j])
+                dp[i][j] = dp[i][j - 1] + 1;
+        }
+    }
+    return dp[len1][len2];
+}
+
+/*The purpose of this function is the same as levenshteinDistance, but only the differences of at most bound are needed.
+This is the banding of Ukkonen: a cell further than bound from the diagonal can not be on a path with a difference of bound or less,
+so only the cells with |i - j| <= bound are calculated, and only two rows of the table are kept.
+If every cell of a row is more than bound, the difference of the words is also more than bound and the function stops.
+A difference more than bound is returned as bound + 1.*/
+int boundedLevenshtein(const char *s1, int len1, const char *s2, int len2, int bound)
+{
+    if (abs(len1 - len2) > bound)
+    {
+        return bound + 1;
+    }
+    if (bound > len1 + len2)
+    {
+        bound = len1 + len2; // the difference is never more than this, and bound + 1 must not overflow below
+    }
+
+    int over = bound + 1;
+    int rows[2][len2 + 1];
+    int *previous = rows[0];
+    int *current = rows[1];
+
+    for (int j = 0; j <= len2; j++)
+        previous[j] = j <= bound ? j : over;
+
+    for (int i = 1; i <= len1; i++)
+    {
+        int low = i - bound > 1 ? i - bound : 1;
+        int high = i + bound < len2 ? i + bound : len2;
+        int row_min = over;
+
+        current[0] = i <= bound ? i : over;
+        if (low == 1)
+            row_min = current[0];
+        else
+            current[low - 1] = over;
+
+        for (int j = low; j <= high; j++)
+        {
+            int cost = (s1[i - 1] == s2[j - 1]) ? 0 : 1;
+            int value = previous[j - 1] + cost;
+            if (previous[j] + 1 < value)
+                value = previous[j] + 1;
+            if (current[j - 1] + 1 < value)
+                value = current[j - 1] + 1;
+            if (value > over)
+                value = over;
+            current[j] = value;
+            if (value < row_min)
+                row_min = value;
+        }
+        if (high < len2)
+            current[high + 1] = over; // the next row reads this cell as the one above it
+
+        if (row_min > bound)
+        {
+            return over;
+        }
+        int *temp = previous;
+        previous = current;
+        current = temp;
+    }
+    return previous[len2] < over ? previous[len2] : over;
+}
+
+// Bit-Parallel Levenshtein Informations
+
+/*The functions below calculate exactly the same difference as levenshteinDistance without the dynamic programming table.
+This is the bit-parallel algorithm of Myers in the form given by Hyyro for the difference of two whole words.
+Instead of the values of one column of the table, only the differences between two neighbour cells are kept:
+Pv has the bit i set if the cell i is one more than the cell above it and Mv if it is one less.
+So a whole column of up to 64 cells is calculated with a few bit operations for every character of the dictionary word.
+The value of the last cell of the column (the difference) is followed in score.
+levenshteinDistance is kept as the reference, the results must be the same.*/
+
+/*The purpose of this function is to prepare the bit masks of the word entered by the user.
+It is done only once for every word, the masks are used for the whole dictionary.*/
+void prepareQuery(LevQuery *query, const char *s1, int len1)
+{
+    query->text = s1;
+    query->length = len1;
+    if (len1 == 0)
+    {
+        query->blocks = 0;
+        return;
+    }
+    if (len1 > LEVENSHTEIN_MAX_BLOCKS * 64)
+    {
+        query->blocks = LEVENSHTEIN_MAX_BLOCKS + 1;
+        return;
+    }
+    query->blocks = (len1 + 63) / 64;
+    memset(query->peq, 0, query->blocks * sizeof(query->peq[0]));
+    for (int i = 0; i < len1; i++)
+    {
+        query->peq[i / 64][(unsigned char)s1[i]] |= (uint64_t)1 << (i % 64);
+    }
+}
+
+/*One column step of one 64-bit block. hin is the horizontal difference (-1, 0 or +1) coming from the block below,
+the returned value is the horizontal difference of the cell selected by out_bit, which goes to the next block.*/
+static inline int advanceBlock(uint64_t *Pv, uint64_t *Mv, uint64_t Eq, int hin, uint64_t out_bit)
+{
+    uint64_t Xv = Eq | *Mv;
+    if (hin < 0)
+    {
+        Eq |= 1;
+    }
+    uint64_t Xh = (((Eq & *Pv) + *Pv) ^ *Pv) | Eq;
+    uint64_t Ph = *Mv | ~(Xh | *Pv);
+    uint64_t Mh = *Pv & Xh;
+    int hout = 0;
+    if (Ph & out_bit)
+    {
+        hout = 1;
+    }
+    else if (Mh & out_bit)
+    {
+        hout = -1;
+    }
+    Ph <<= 1;
+    Mh <<= 1;
+    if (hin < 0)
+    {
+        Mh |= 1;
+    }
+    else if (hin > 0)
+    {
+        Ph |= 1;
+    }
+    *Pv = Mh | ~(Xv | Ph);
+    *Mv = Ph & Xv;
+    return hout;
+}
+
+/*The purpose of this function is to calculate the difference between the prepared word and one dictionary word.
+The first row of the table is 0, 1, 2 ..., so +1 goes into the lowest block for every character.
+The last cell can decrease by at most 1 for every remaining character of s2, so when score minus the remaining characters
+is already more than bound, the difference can not be bound or less any more and the calculation stops with bound + 1.*/
+int queryDistance(const LevQuery *query, const char *s2, int len2, int bound)
+{
+    if (abs(query->length - len2) > bound)
+    {
+        return bound + 1;
+    }
+    if (query->blocks == 0)
+    {
+        return len2;
+    }
+    if (query->blocks > LEVENSHTEIN_MAX_BLOCKS)
+    {
+        return boundedLevenshtein(query->text, query->length, s2, len2, bound);
+    }
+
+    int last = query->blocks - 1;
+    uint64_t last_bit = (uint64_t)1 << ((query->length - 1) % 64);
+    uint64_t Pv[LEVENSHTEIN_MAX_BLOCKS];
+    uint64_t Mv[LEVENSHTEIN_MAX_BLOCKS];
+    int score = query->length;
+
+    for (int b = 0; b < query->blocks; b++)
+    {
+        Pv[b] = ~(uint64_t)0;
+        Mv[b] = 0;
+    }
+    for (int j = 0; j < len2; j++)
+    {
+        unsigned char c = (unsigned char)s2[j];
+        int carry = 1;
+        for (int b = 0; b < last; b++)
+        {
+            carry = advanceBlock(&Pv[b], &Mv[b], query->peq[b][c], carry, (uint64_t)1 << 63);
+        }
+        score += advanceBlock(&Pv[last], &Mv[last], query->peq[last][c], carry, last_bit);
+        if (score - (len2 - j - 1) > bound)
+        {
+            return bound + 1;
+        }
+    }
+    return score > bound ? bound + 1 : score;
+}
+
+/*The kernel used when the CPU has neither AVX2 nor SSE4.1, the words are calculated one by one.*/
+void distancesScalar(const LevQuery *query, const char *const *words, const int *lengths, const int *bounds, int count, int *out)
+{
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = queryDistance(query, words[i], lengths[i], bounds[i]);
+    }
+}
+
+#ifdef LEVENSHTEIN_X86
+/*The SIMD kernels calculate several dictionary words at the same time, one word in every 64-bit lane of a register.
+All lanes use the same masks of the prepared word, only the character of the dictionary word (so Eq) is different.
+A lane whose word has ended keeps running with Eq = 0, but its score is not changed any more.
+Every 4 characters the lanes are checked against their bounds like in queryDistance, and the batch stops
+when no lane can be bound or less any more. Only words of up to 64 characters fit into one lane, longer prepared words use the scalar kernel.*/
+__attribute__((target("avx2"))) void distancesAVX2(const LevQuery *query, const char *const *words, const int *lengths, const int *bounds, int count, int *out)
+{
+    if (query->blocks != 1)
+    {
+        distancesScalar(query, words, lengths, bounds, count, out);
+        return;
+    }
+
+    const __m256i ones = _mm256_set1_epi64x(-1);
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m128i shift = _mm_cvtsi32_si128(query->length - 1);
+
+    for (int base = 0; base < count; base += 4)
+    {
+        int n = count - base < 4 ? count - base : 4;
+        int max_length = 0;
+        int lane_length[4] = {0, 0, 0, 0};
+        int lane_bound[4] = {0, 0, 0, 0};
+        bool over_bound[4] = {false, false, false, false};
+        const char *lane_word[4] = {"", "", "", ""};
+        for (int k = 0; k < n; k++)
+        {
+            lane_word[k] = words[base + k];
+            lane_length[k] = lengths[base + k];
+            lane_bound[k] = bounds[base + k];
+            if (abs(query->length - lane_length[k]) > lane_bound[k])
+            {
+                over_bound[k] = true; // the length difference alone is too much
+                lane_length[k] = 0;
+            }
+            if (lane_length[k] > max_length)
+            {
+                max_length = lane_length[k];
+            }
+        }
+
+        __m256i Pv = ones;
+        __m256i Mv = _mm256_setzero_si256();
+        __m256i score = _mm256_set1_epi64x(query->length);
+        for (int j = 0; j < max_length; j++)
+        {
+            uint64_t eq[4];
+            int64_t active[4];
+            for (int k = 0; k < 4; k++)
+            {
+                bool in_word = j < lane_length[k];
+                eq[k] = in_word ? query->peq[0][(unsigned char)lane_word[k][j]] : 0;
+                active[k] = in_word ? -1 : 0;
+            }
+            __m256i Eq = _mm256_loadu_si256((const __m256i *)eq);
+            __m256i act = _mm256_loadu_si256((const __m256i *)active);
+
+            __m256i Xv = _mm256_or_si256(Eq, Mv);
+            __m256i Xh = _mm256_or_si256(_mm256_xor_si256(_mm256_add_epi64(_mm256_and_si256(Eq, Pv), Pv), Pv), Eq);
+            __m256i Ph = _mm256_or_si256(Mv, _mm256_xor_si256(_mm256_or_si256(Xh, Pv), ones));
+            __m256i Mh = _mm256_and_si256(Pv, Xh);
+            __m256i delta = _mm256_sub_epi64(_mm256_and_si256(_mm256_srl_epi64(Ph, shift), one),
+                                             _mm256_and_si256(_mm256_srl_epi64(Mh, shift), one));
+            score = _mm256_add_epi64(score, _mm256_and_si256(delta, act));
+            Ph = _mm256_or_si256(_mm256_slli_epi64(Ph, 1), one);
+            Mh = _mm256_slli_epi64(Mh, 1);
+            Pv = _mm256_or_si256(Mh, _mm256_xor_si256(_mm256_or_si256(Xv, Ph), ones));
+            Mv = _mm256_and_si256(Ph, Xv);
+
+            if ((j & 3) == 3 && j + 1 < max_length)
+            {
+                int64_t scores[4];
+                bool alive = false;
+                _mm256_storeu_si256((__m256i *)scores, score);
+                for (int k = 0; k < n; k++)
+                {
+                    if (!over_bound[k] && j + 1 < lane_length[k])
+                    {
+                        if (scores[k] - (lane_length[k] - j - 1) > lane_bound[k])
+                        {
+                            over_bound[k] = true;
+                        }
+                        else
+                        {
+                            alive = true;
+                        }
+                    }
+                }
+                if (!alive)
+                {
+                    break;
+                }
+            }
+        }
+
+        int64_t scores[4];
+        _mm256_storeu_si256((__m256i *)scores, score);
+        for (int k = 0; k < n; k++)
+        {
+            out[base + k] = over_bound[k] || scores[k] > lane_bound[k] ? lane_bound[k] + 1 : (int)scores[k];
+        }
+    }
+}
+
+/*The same kernel with 128-bit registers, two dictionary words at the same time.*/
+__attribute__((target("sse4.1"))) void distancesSSE41(const LevQuery *query, const char *const *words, const int *lengths, const int *bounds, int count, int *out)
+{
+    if (query->blocks != 1)
+    {
+        distancesScalar(query, words, lengths, bounds, count, out);
+        return;
+    }
+
+    const __m128i ones = _mm_set1_epi64x(-1);
+    const __m128i one = _mm_set1_epi64x(1);
+    const __m128i shift = _mm_cvtsi32_si128(query->length - 1);
+
+    for (int base = 0; base < count; base += 2)
+    {
+        int n = count - base < 2 ? count - base : 2;
+        int length0 = lengths[base];
+        int length1 = n > 1 ? lengths[base + 1] : 0;
+        int bound0 = bounds[base];
+        int bound1 = n > 1 ? bounds[base + 1] : 0;
+        bool over0 = abs(query->length - length0) > bound0;
+        bool over1 = n > 1 && abs(query->length - length1) > bound1;
+        const char *word0 = words[base];
+        const char *word1 = n > 1 ? words[base + 1] : "";
+        if (over0)
+        {
+            length0 = 0;
+        }
+        if (over1)
+        {
+            length1 = 0;
+        }
+        int max_length = length0 > length1 ? length0 : length1;
+
+        __m128i Pv = ones;
+        __m128i Mv = _mm_setzero_si128();
+        __m128i score = _mm_set1_epi64x(query->length);
+        for (int j = 0; j < max_length; j++)
+        {
+            uint64_t eq0 = j < length0 ? query->peq[0][(unsigned char)word0[j]] : 0;
+            uint64_t eq1 = j < length1 ? query->peq[0][(unsigned char)word1[j]] : 0;
+            __m128i Eq = _mm_set_epi64x((int64_t)eq1, (int64_t)eq0);
+            __m128i act = _mm_set_epi64x(j < length1 ? -1 : 0, j < length0 ? -1 : 0);
+
+            __m128i Xv = _mm_or_si128(Eq, Mv);
+            __m128i Xh = _mm_or_si128(_mm_xor_si128(_mm_add_epi64(_mm_and_si128(Eq, Pv), Pv), Pv), Eq);
+            __m128i Ph = _mm_or_si128(Mv, _mm_xor_si128(_mm_or_si128(Xh, Pv), ones));
+            __m128i Mh = _mm_and_si128(Pv, Xh);
+            __m128i delta = _mm_sub_epi64(_mm_and_si128(_mm_srl_epi64(Ph, shift), one),
+                                          _mm_and_si128(_mm_srl_epi64(Mh, shift), one));
+            score = _mm_add_epi64(score, _mm_and_si128(delta, act));
+            Ph = _mm_or_si128(_mm_slli_epi64(Ph, 1), one);
+            Mh = _mm_slli_epi64(Mh, 1);
+            Pv = _mm_or_si128(Mh, _mm_xor_si128(_mm_or_si128(Xv, Ph), ones));
+            Mv = _mm_and_si128(Ph, Xv);
+
+            if ((j & 3) == 3 && j + 1 < max_length)
+            {
+                if (!over0 && j + 1 < length0 && _mm_extract_epi64(score, 0) - (length0 - j - 1) > bound0)
+                {
+                    over0 = true;
+                }
+                if (!over1 && j + 1 < length1 && _mm_extract_epi64(score, 1) - (length1 - j - 1) > bound1)
+                {
+                    over1 = true;
+                }
+                if ((over0 || j + 1 >= length0) && (over1 || j + 1 >= length1))
+                {
+                    break;
+                }
+            }
+        }
+
+        int64_t score0 = _mm_extract_epi64(score, 0);
+        int64_t score1 = _mm_extract_epi64(score, 1);
+        out[base] = over0 || score0 > bound0 ? bound0 + 1 : (int)score0;
+        if (n > 1)
+        {
+            out[base + 1] = over1 || score1 > bound1 ? bound1 + 1 : (int)score1;
+        }
+    }
+}
+#else
+void distancesAVX2(const LevQuery *query, const char *const *words, const int *lengths, const int *bounds, int count, int *out)
+{
+    distancesScalar(query, words, lengths, bounds, count, out);
+}
+
+void distancesSSE41(const LevQuery *query, const char *const *words, const int *lengths, const int *bounds, int count, int *out)
+{
+    distancesScalar(query, words, lengths, bounds, count, out);
+}
+#endif
+
+/*The purpose of this function is to choose the widest kernel that the CPU of the server supports.
+It is called once at the beginning of main, before any word is calculated.*/
+void selectDistanceKernel(void)
+{
+#ifdef LEVENSHTEIN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        distance_kernel = distancesAVX2;
+        distance_lanes = 4;
+        return;
+    }
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        distance_kernel = distancesSSE41;
+        distance_lanes = 2;
+        return;
+    }
+#endif
+    distance_kernel = distancesScalar;
+    distance_lanes = 1;
+}
+
+/*The purpose of using the TopWords function is to put the closest words found by a search into the order of the answer.
+The heap of the search is sorted using the compare method written for the qsort function.
+Then, the top words are transferred to the result of the word, which is kept in the task of the word, so a search allocates nothing.
+If less words than the limit were found, the rest of the result is left empty.*/
+void TopWords(LevInfo *heap, int found, LevInfo *TopLevenshtein)
+{
+    qsort(heap, found, sizeof(LevInfo), compareLevInfo);
+    for (int i = 0; i < LEVENSHTEIN_LIST_LIMIT; i++)
+    {
+        if (i < found)
+        {
+            TopLevenshtein[i] = heap[i];
+        }
+        else
+        {
+            TopLevenshtein[i].word = NO_WORD;
+            TopLevenshtein[i].diff = INT_MAX;
+        }
+    }
+}
+
+// Parallel Scan Informations
+
+/*A scan of a large dictionary is one long loop, so a sentence of one word would use only one core.
+When the dictionary file has at least PARALLEL_SCAN_WORDS words, the worker that scans divides the words into chunks
+and gives helper tasks to the other workers. Every worker takes chunks until none is left, the chunks whose lengths are
+closest to the word first, and every chunk keeps its own closest words. The worker that started the scan merges them at the end.*/
+
+/*The purpose of this function is to scan the words of the dictionary file with the help of the other workers
+and to put the closest of them into the heap of the caller. The words added later are scanned by the caller as before.
+A helper that starts after every chunk has been taken only releases the scan, so nobody waits for a helper that has not started.*/
+void scanParallel(const char *s1, int len1, LevInfo *heap, int *found)
+{
+    ScanJob *job;
+    uint32_t chunk_words = SCAN_CHUNK_WORDS;
+    int distance[SCAN_MAX_CHUNKS];
+
+    pthread_mutex_lock(&scan_mutex);
+    job = spare_scans;
+    if (job != NULL)
+    {
+        spare_scans = job->next;
+    }
+    pthread_mutex_unlock(&scan_mutex);
+    if (job == NULL)
+    {
+        job = malloc(sizeof(ScanJob));
+        if (job == NULL)
+        {
+            perror("Error allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        pthread_mutex_init(&job->mutex, NULL);
+        pthread_cond_init(&job->cond, NULL);
+    }
+
+    while ((dict.base_count + chunk_words - 1) / chunk_words > SCAN_MAX_CHUNKS)
+    {
+        chunk_words *= 2;
+    }
+    job->word = s1;
+    job->length = len1;
+    job->chunk_words = chunk_words;
+    job->chunk_count = (dict.base_count + chunk_words - 1) / chunk_words;
+
+    /*The words are sorted by length, so the first and the last word of a chunk give the lengths in it.
+    The chunks are ordered by the difference of these lengths from the length of the word (insertion sort, the order is kept for equal ones).*/
+    for (int c = 0; c < job->chunk_count; c++)
+    {
+        uint32_t first = c * chunk_words;
+        uint32_t last = first + chunk_words < dict.base_count ? first + chunk_words - 1 : dict.base_count - 1;
+        int shortest = dict.base_lengths[first];
+        int longest = dict.base_lengths[last];
+        int k = c;
+
+        distance[c] = len1 < shortest ? shortest - len1 : (len1 > longest ? len1 - longest : 0);
+        while (k > 0 && distance[job->order[k - 1]] > distance[c])
+        {
+            job->order[k] = job->order[k - 1];
+            k--;
+        }
+        job->order[k] = c;
+    }
+    atomic_store(&job->next_chunk, 0);
+    atomic_store(&job->finished_chunks, 0);
+    atomic_store(&job->bound, NO_BOUND);
+
+    int helpers = pool.size - 1 < job->chunk_count - 1 ? pool.size - 1 : job->chunk_count - 1;
+    atomic_store(&job->references, helpers + 1);
+    for (int i = 0; i < helpers; i++)
+    {
+        submitTask(&pool, scanHelper, job);
+    }
+
+    scanChunks(job);
+    /*Every chunk has been taken, only the chunks that the helpers are scanning at this moment are waited for.*/
+    pthread_mutex_lock(&job->mutex);
+    while (atomic_load(&job->finished_chunks) < job->chunk_count)
+    {
+        pthread_cond_wait(&job->cond, &job->mutex);
+    }
+    pthread_mutex_unlock(&job->mutex);
+    for (int c = 0; c < job->chunk_count; c++)
+    {
+        for (int i = 0; i < job->found[c]; i++)
+        {
+            pushTopWord(heap, found, job->heaps[c][i].word, job->heaps[c][i].diff);
+        }
+    }
+    releaseScan(job);
+}
+
+/*This is the task that the other workers run to help a scan.*/
+void *scanHelper(void *arg)
+{
+    ScanJob *job = (ScanJob *)arg;
+
+    scanChunks(job);
+    releaseScan(job);
+    return NULL;
+}
+
+/*The purpose of this function is to take the chunks of a scan one by one until none is left, and to find the closest words of every chunk.
+The threshold of a chunk is also limited by the bound of the scan, the difference of the worst word of the full heap of any chunk:
+a word further than that has LEVENSHTEIN_LIST_LIMIT better words in that chunk, so it can not be in the answer.
+A word whose difference is equal to the bound is still kept, so the merged answer is exactly the answer of the serial scan.
+The words of a chunk are sorted by length, so the chunk ends at the first word that is too long.*/
+void scanChunks(ScanJob *job)
+{
+    int c;
+
+    while ((c = atomic_fetch_add(&job->next_chunk, 1)) < job->chunk_count)
+    {
+        int chunk = job->order[c];
+        LevInfo *heap = job->heaps[chunk];
+        int found = 0;
+        uint32_t first = chunk * job->chunk_words;
+        uint32_t end = first + job->chunk_words < dict.base_count ? first + job->chunk_words : dict.base_count;
+
+        for (uint32_t m = first; m < end; m++)
+        {
+            int threshold = topThreshold(heap, found);
+            int bound = atomic_load_explicit(&job->bound, memory_order_relaxed);
+            int len2 = dict.base_lengths[m];
+            if (bound < threshold)
+            {
+                threshold = bound;
+            }
+            if (len2 > job->length + threshold)
+            {
+                break;
+            }
+            if (len2 < job->length - threshold)
+            {
+                continue;
+            }
+            int diff = boundedLevenshtein(job->word, job->length, dict.base_characters + dict.base_offsets[m], len2, threshold);
+            if (diff > threshold)
+            {
+                continue;
+            }
+            pushTopWord(heap, &found, m, diff);
+            if (found == LEVENSHTEIN_LIST_LIMIT)
+            {
+                int known = atomic_load_explicit(&job->bound, memory_order_relaxed);
+                while (heap[0].diff < known && !atomic_compare_exchange_weak(&job->bound, &known, heap[0].diff))
+                {
+                }
+            }
+        }
+        job->found[chunk] = found;
+        if (atomic_fetch_add(&job->finished_chunks, 1) == job->chunk_count - 1)
+        {
+            pthread_mutex_lock(&job->mutex);
+            pthread_cond_signal(&job->cond);
+            pthread_mutex_unlock(&job->mutex);
+        }
+    }
+}
+
+/*The purpose of this function is to give up the scan. The last one that gives it up keeps it for the next scan.*/
+void releaseScan(ScanJob *job)
+{
+    if (atomic_fetch_sub(&job->references, 1) == 1)
+    {
+        pthread_mutex_lock(&scan_mutex);
+        job->next = spare_scans;
+        spare_scans = job;
+        pthread_mutex_unlock(&scan_mutex);
+    }
+}
+
+/*The purpose of this function is to free the kept scans when the workers have stopped.*/
+void freeSpareScans(void)
+{
+    while (spare_scans != NULL)
+    {
+        ScanJob *job = spare_scans;
+        spare_scans = job->next;
+        pthread_mutex_destroy(&job->mutex);
+        pthread_cond_destroy(&job->cond);
+        free(job);
+    }
+}
+
+// Top Words Heap Informations
+
+/*The closest words of a search are kept in a max-heap of LEVENSHTEIN_LIST_LIMIT elements ordered by compareLevInfo.
+The root of the heap is the worst of the best words, so a new word only has to be compared with the root:
+if it is not better, it is skipped, otherwise it replaces the root and sinks to its place.
+Only the number of a word is put into the heap, its characters are compared only when two differences are equal.*/
+
+/*The difference that a new word must not exceed to be able to enter the heap.
+When the heap is not full yet, every word can enter it.*/
+int topThreshold(const LevInfo *heap, int found)
+{
+    return found < LEVENSHTEIN_LIST_LIMIT ? NO_BOUND : heap[0].diff;
+}
+
+/*The purpose of this function is to offer a word with its difference to the heap.*/
+void pushTopWord(LevInfo *heap, int *found, uint32_t word, int diff)
+{
+    int position;
+
+    if (*found == LEVENSHTEIN_LIST_LIMIT)
+    {
+        if (diff > heap[0].diff || (diff == heap[0].diff && strcmp(dictionaryWord(word), dictionaryWord(heap[0].word)) >= 0))
+        {
+            return; // not better than the worst word of the heap
+        }
+        // The root is replaced and the new word sinks down while one of its children is worse than it.
+        position = 0;
+        while (true)
+        {
+            int child = 2 * position + 1;
+            if (child >= LEVENSHTEIN_LIST_LIMIT)
+            {
+                break;
+            }
+            if (child + 1 < LEVENSHTEIN_LIST_LIMIT && compareLevInfo(&heap[child + 1], &heap[child]) > 0)
+            {
+                child++;
+            }
+            if (heap[child].diff < diff || (heap[child].diff == diff && strcmp(dictionaryWord(heap[child].word), dictionaryWord(word)) < 0))
+            {
+                break;
+            }
+            heap[position] = heap[child];
+            position = child;
+        }
+    }
+    else
+    {
+        // The heap is not full, the new word is put at the end and rises while its parent is better than it.
+        position = (*found)++;
+        while (position > 0)
+        {
+            int parent = (position - 1) / 2;
+            if (heap[parent].diff > diff || (heap[parent].diff == diff && strcmp(dictionaryWord(heap[parent].word), dictionaryWord(word)) > 0))
+            {
+                break;
+            }
+            heap[position] = heap[parent];
+            position = parent;
+        }
+    }
+    heap[position].word = word;
+    heap[position].diff = diff;
+}
+
+// Result Cache Informations
+
+/*The same words come again and again, so the result of a word is kept in a cache after it is calculated.
+The cache is divided into CACHE_SHARDS shards by the hash of the word, every shard has its own lock, hash table,
+least recently used list and part of the memory budget. When a shard uses more memory than its part, its least recently used
+entries are removed.
+An entry is not thrown away when a word is added to the dictionary. It remembers the number of dictionary words it was
+calculated with, and when it is found again only the words added after that are compared with it (refreshResult).
+So an added word changes only the entries that it really enters, and the others are not calculated again.*/
+
+/*The purpose of this function is to prepare the shards of the cache. A budget of 0 turns the cache off.*/
+void createCache(size_t budget)
+{
+    for (int i = 0; i < CACHE_SHARDS; i++)
+    {
+        CacheShard *shard = &cache_shards[i];
+        memset(shard, 0, sizeof(CacheShard));
+        pthread_mutex_init(&shard->mutex, NULL);
+        shard->budget = budget / CACHE_SHARDS;
+        shard->bucket_count = 64;
+        shard->buckets = calloc(shard->bucket_count, sizeof(CacheEntry *));
+        if (shard->buckets == NULL)
+        {
+            perror("Error allocating memory");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/*The purpose of this function is to release every entry of the cache and to print how useful the cache was.*/
+void freeCache(void)
+{
+    unsigned long hits = 0, misses = 0, evictions = 0;
+    for (int i = 0; i < CACHE_SHARDS; i++)
+    {
+        CacheShard *shard = &cache_shards[i];
+        CacheEntry *entry = shard->newest;
+        while (entry != NULL)
+        {
+            CacheEntry *older = entry->older;
+            free(entry);
+            entry = older;
+        }
+        free(shard->buckets);
+        pthread_mutex_destroy(&shard->mutex);
+        hits += shard->hits;
+        misses += shard->misses;
+        evictions += shard->evictions;
+    }
+    printf("Result cache: %lu hits, %lu misses, %lu evictions\n", hits, misses, evictions);
+}
+
+/*FNV-1a hash of a word. The upper half selects the shard and the lowest bits the bucket in the shard.*/
+uint32_t hashWord(const char *word)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; word[i] != '\0'; i++)
+    {
+        hash ^= (unsigned char)word[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*The purpose of this function is to find the result of a word in the cache and to copy it into result.
+version is the number of words of the dictionary version that the caller reads. If words were added to the dictionary
+since the entry was brought up to date, they are compared with the word after the shard is unlocked, so the other workers
+of the shard do not wait for it, and the refreshed result is stored again. If another worker has already stored
+a result of a newer version, that result is returned and version is set to its version.
+Returns true if the word was in the cache.*/
+bool cacheLookup(const char *word, uint32_t *version, LevInfo *result)
+{
+    uint32_t hash = hashWord(word);
+    CacheShard *shard = &cache_shards[(hash >> 16) % CACHE_SHARDS];
+    CacheEntry *entry;
+    uint32_t cached;
+
+    if (shard->budget == 0)
+    {
+        return false;
+    }
+    pthread_mutex_lock(&shard->mutex);
+    for (entry = shard->buckets[hash & (shard->bucket_count - 1)]; entry != NULL; entry = entry->hash_next)
+    {
+        if (entry->hash == hash && strcmp(entry->word, word) == 0)
+        {
+            break;
+        }
+    }
+    if (entry == NULL)
+    {
+        shard->misses++;
+        pthread_mutex_unlock(&shard->mutex);
+        return false;
+    }
+    cached = entry->version;
+    memcpy(result, entry->result, sizeof(entry->result));
+    shard->hits++;
+
+    // The entry becomes the most recently used one.
+    if (shard->newest != entry)
+    {
+        entry->newer->older = entry->older;
+        if (entry->older != NULL)
+        {
+            entry->older->newer = entry->newer;
+        }
+        else
+        {
+            shard->oldest = entry->newer;
+        }
+        entry->newer = NULL;
+        entry->older = shard->newest;
+        shard->newest->newer = entry;
+        shard->newest = entry;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+
+    if (cached < *version)
+    {
+        refreshResult(result, word, cached);
+        cacheStore(word, *version, result);
+    }
+    else
+    {
+        *version = cached;
+    }
+    return true;
+}
+
+/*The purpose of this function is to put the result of a word into the cache after it was calculated.
+If another worker has put the same word meanwhile, the newer of the two results is kept.
+The least recently used entries are removed until the shard fits into its budget again.*/
+void cacheStore(const char *word, uint32_t version, const LevInfo *result)
+{
+    uint32_t hash = hashWord(word);
+    CacheShard *shard = &cache_shards[(hash >> 16) % CACHE_SHARDS];
+    size_t length = strlen(word);
+    CacheEntry *entry;
+
+    if (shard->budget == 0)
+    {
+        return;
+    }
+    pthread_mutex_lock(&shard->mutex);
+    for (entry = shard->buckets[hash & (shard->bucket_count - 1)]; entry != NULL; entry = entry->hash_next)
+    {
+        if (entry->hash == hash && strcmp(entry->word, word) == 0)
+        {
+            if (entry->version < version)
+            {
+                memcpy(entry->result, result, sizeof(entry->result));
+                entry->version = version;
+            }
+            pthread_mutex_unlock(&shard->mutex);
+            return;
+        }
+    }
+
+    entry = malloc(sizeof(CacheEntry) + length + 1);
+    if (entry == NULL)
+    {
+        pthread_mutex_unlock(&shard->mutex);
+        return; // the cache is only a help, the result is still returned to the client
+    }
+    entry->hash = hash;
+    entry->version = version;
+    entry->size = sizeof(CacheEntry) + length + 1;
+    memcpy(entry->result, result, sizeof(entry->result));
+    memcpy(entry->word, word, length + 1);
+
+    // The hash table is doubled when it has more entries than buckets, so the chains stay short.
+    if (shard->entry_count >= shard->bucket_count)
+    {
+        size_t bucket_count = shard->bucket_count * 2;
+        CacheEntry **buckets = calloc(bucket_count, sizeof(CacheEntry *));
+        if (buckets != NULL)
+        {
+            for (size_t b = 0; b < shard->bucket_count; b++)
+            {
+                CacheEntry *next;
+                for (CacheEntry *moved = shard->buckets[b]; moved != NULL; moved = next)
+                {
+                    next = moved->hash_next;
+                    moved->hash_next = buckets[moved->hash & (bucket_count - 1)];
+                    buckets[moved->hash & (bucket_count - 1)] = moved;
+                }
+            }
+            free(shard->buckets);
+            shard->buckets = buckets;
+            shard->bucket_count = bucket_count;
+        }
+    }
+    entry->hash_next = shard->buckets[hash & (shard->bucket_count - 1)];
+    shard->buckets[hash & (shard->bucket_count - 1)] = entry;
+    entry->newer = NULL;
+    entry->older = shard->newest;
+    if (shard->newest != NULL)
+    {
+        shard->newest->newer = entry;
+    }
+    else
+    {
+        shard->oldest = entry;
+    }
+    shard->newest = entry;
+    shard->entry_count++;
+    shard->memory += entry->size;
+
+    while (shard->memory > shard->budget && shard->oldest != NULL)
+    {
+        CacheEntry *oldest = shard->oldest;
+        cacheUnlink(shard, oldest);
+        free(oldest);
+        shard->evictions++;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+/*The purpose of this function is to take an entry out of the hash table and the list of its shard.
+The caller holds the lock of the shard and frees the entry.*/
+void cacheUnlink(CacheShard *shard, CacheEntry *entry)
+{
+    CacheEntry **link = &shard->buckets[entry->hash & (shard->bucket_count - 1)];
+    while (*link != entry)
+    {
+        link = &(*link)->hash_next;
+    }
+    *link = entry->hash_next;
+
+    if (entry->newer != NULL)
+    {
+        entry->newer->older = entry->older;
+    }
+    else
+    {
+        shard->newest = entry->older;
+    }
+    if (entry->older != NULL)
+    {
+        entry->older->newer = entry->newer;
+    }
+    else
+    {
+        shard->oldest = entry->newer;
+    }
+    shard->entry_count--;
+    shard->memory -= entry->size;
+}
+
+// BK-Tree Informations
+
+/*A BK-tree is a tree of the dictionary words where every child is kept together with its Levenshtein difference to its parent.
+Because the Levenshtein difference is a metric, the triangle inequality says that for a word w, a node n and a child c of n
+|d(w, n) - d(n, c)| <= d(w, c). So if the current 5th best difference is t, only the children whose difference to the node is
+between d(w, n) - t and d(w, n) + t can contain a better word, and all the other subtrees are skipped without being compared.
+The words themselves are not copied, the nodes keep the numbers of the words in the dictionary.
+A word never changes its number, so the tree stays valid when words are added and the dictionary is saved.*/
+
+/*The purpose of this function is to put a new dictionary word into the tree. It is used both when the dictionary is loaded
+and when the user adds a word. The same word can be inserted more than once (difference 0), exactly like the dictionary can hold it twice.
+Only the event loop inserts. The new node is complete before the new children list that contains it is published,
+so a worker sees either the old list or the new one, never a half written node.*/
+void insertBKTree(BKNode **root, uint32_t word)
+{
+    BKNode *node = calloc(1, sizeof(BKNode));
+    if (node == NULL)
+    {
+        perror("Error allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    node->word = word;
+    node->length = dictionaryLength(word);
+    atomic_init(&node->max_child_distance, -1);
+    atomic_init(&node->children, NULL);
+
+    if (*root == NULL)
+    {
+        atomic_store_explicit((BKNode *_Atomic *)root, node, memory_order_release);
+        return;
+    }
+
+    LevQuery query;
+    prepareQuery(&query, dictionaryWord(word), node->length);
+    BKNode *current = *root;
+    while (true)
+    {
+        int distance = queryDistance(&query, dictionaryWord(current->word), current->length, NO_BOUND);
+        BKChildList *children = atomic_load_explicit(&current->children, memory_order_relaxed);
+        int count = children == NULL ? 0 : children->count;
+        BKNode *next = NULL;
+        for (int i = 0; i < count; i++)
+        {
+            if (children->child[i].distance == distance)
+            {
+                next = children->child[i].node;
+                break;
+            }
+        }
+        if (next != NULL)
+        {
+            current = next;
+            continue;
+        }
+
+        // The node does not have a child at this difference yet, so the new word becomes that child in a copy of the list.
+        BKChildList *copy = malloc(sizeof(BKChildList) + (count + 1) * sizeof(BKChild));
+        if (copy == NULL)
+        {
+            perror("Error allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        if (count > 0)
+        {
+            memcpy(copy->child, children->child, count * sizeof(BKChild));
+        }
+        copy->child[count].distance = distance;
+        copy->child[count].node = node;
+        copy->count = count + 1;
+        if (distance > atomic_load_explicit(&current->max_child_distance, memory_order_relaxed))
+        {
+            atomic_store_explicit(&current->max_child_distance, distance, memory_order_relaxed);
+        }
+        atomic_store_explicit(&current->children, copy, memory_order_release);
+        if (children != NULL)
+        {
+            retireMemory(children);
+        }
+        return;
+    }
+}
+
+/*The purpose of this function is to find the closest LEVENSHTEIN_LIST_LIMIT words of s1 in the tree.
+The tree is walked with a stack instead of recursion, because a tree built from a large dictionary can be deep.
+Every entry of the stack keeps the smallest difference that its subtree can have (from the triangle inequality),
+so an entry that was pushed when the list was not full yet is still skipped if the list has become better since then.
+Up to LEVENSHTEIN_LANES nodes are taken from the stack at once so that the SIMD kernel can calculate them together.
+The exact difference of a node is needed only if it can enter the heap or if one of its children can still be visited,
+so the calculation of a node stops at threshold + max_child_distance.
+The heap and the stack are on the stack of the thread, the stack is moved to the scratch arena only if a search needs more.
+The tree can grow while it is searched. A node whose word is newer than the version that the thread reads is skipped
+with all of its children, because every word below it was added after it.*/
+void searchBKTree(BKNode *root, const char *s1, LevInfo *result)
+{
+    LevInfo heap[LEVENSHTEIN_LIST_LIMIT] = {{0}};
+    int found = 0;
+    BKStackEntry local_stack[128];
+    BKStackEntry *stack = local_stack;
+    int stack_size = 0;
+    int stack_capacity = sizeof(local_stack) / sizeof(local_stack[0]);
+    LevQuery query;
+    uint32_t count = dictionaryVersion()->count;
+
+    prepareQuery(&query, s1, strlen(s1));
+
+    stack[stack_size].node = root;
+    stack[stack_size].lower_bound = 0;
+    stack_size++;
+
+    while (stack_size > 0)
+    {
+        BKNode *batch[LEVENSHTEIN_LANES];
+        const char *words[LEVENSHTEIN_LANES];
+        int lengths[LEVENSHTEIN_LANES];
+        int bounds[LEVENSHTEIN_LANES];
+        int distances[LEVENSHTEIN_LANES];
+        int batch_size = 0;
+        int threshold = topThreshold(heap, found);
+
+        while (stack_size > 0 && batch_size < distance_lanes)
+        {
+            BKStackEntry entry = stack[--stack_size];
+            if (entry.lower_bound > threshold || entry.node->word >= count)
+            {
+                continue;
+            }
+            int max_child_distance = atomic_load_explicit(&entry.node->max_child_distance, memory_order_relaxed);
+            batch[batch_size] = entry.node;
+            words[batch_size] = dictionaryWord(entry.node->word);
+            lengths[batch_size] = entry.node->length;
+            bounds[batch_size] = threshold == NO_BOUND ? NO_BOUND : threshold + (max_child_distance > 0 ? max_child_distance : 0);
+            batch_size++;
+        }
+        if (batch_size == 0)
+        {
+            break;
+        }
+        distance_kernel(&query, words, lengths, bounds, batch_size, distances);
+
+        for (int k = 0; k < batch_size; k++)
+        {
+            BKNode *node = batch[k];
+            int distance = distances[k];
+            BKChildList *children = atomic_load_explicit(&node->children, memory_order_acquire);
+            pushTopWord(heap, &found, node->word, distance);
+            threshold = topThreshold(heap, found);
+
+            for (int i = 0; children != NULL && i < children->count; i++)
+            {
+                int lower_bound = abs(distance - children->child[i].distance);
+                if (lower_bound > threshold)
+                {
+                    continue;
+                }
+                if (stack_size >= stack_capacity)
+                {
+                    // A deep search continues in the scratch arena of the thread
+                    BKStackEntry *temp = arenaAlloc(&scratch_arena, stack_capacity * 2 * sizeof(BKStackEntry));
+                    memcpy(temp, stack, stack_capacity * sizeof(BKStackEntry));
+                    stack_capacity *= 2;
+                    stack = temp;
+                }
+                stack[stack_size].node = children->child[i].node;
+                stack[stack_size].lower_bound = lower_bound;
+                stack_size++;
+            }
+        }
+    }
+    if (stack != local_stack)
+    {
+        arenaReset(&scratch_arena);
+    }
+
+    TopWords(heap, found, result);
+}
+
+// Free the memory allocated for the BK-tree, the words belong to the dictionary and are freed by freeDictionary
+void freeBKTree(BKNode *root)
+{
+    if (root == NULL)
+    {
+        return;
+    }
+    int stack_size = 0;
+    int stack_capacity = 64;
+    BKNode **stack = malloc(stack_capacity * sizeof(BKNode *));
+    stack[stack_size++] = root;
+    while (stack_size > 0)
+    {
+        BKNode *node = stack[--stack_size];
+        BKChildList *children = atomic_load_explicit(&node->children, memory_order_relaxed);
+        for (int i = 0; children != NULL && i < children->count; i++)
+        {
+            if (stack_size >= stack_capacity)
+            {
+                stack_capacity *= 2;
+                stack = realloc(stack, stack_capacity * sizeof(BKNode *));
+            }
+            stack[stack_size++] = children->child[i].node;
+        }
+        free(children);
+        free(node);
+    }
+    free(stack);
+}
+
+// Symmetric Delete Index Informations
+
+/*The purpose of this function is to find the keys of a word: the hashes of the strings made by deleting
+at most symspell_distance of its characters, the word itself included. Every hash is given once.
+Returns the number of keys, *keys is allocated in the scratch arena of the thread and the caller resets it.*/
+int wordDeletes(const char *word, int length, uint32_t **keys)
+{
+    // The number of the strings is at most the sum of (length choose k) for k = 0 ... symspell_distance
+    size_t total = 0, choose = 1;
+    for (int k = 0; k <= symspell_distance && k <= length; k++)
+    {
+        total += choose;
+        choose = choose * (length - k) / (k + 1);
+    }
+    *keys = arenaAlloc(&scratch_arena, total * sizeof(uint32_t));
+    int count = 0;
+    collectDeletes(word, length, 0, symspell_distance, *keys, &count);
+
+    // The same string comes from different deletions of repeated letters ("letter" -> "leter" twice)
+    qsort(*keys, count, sizeof(uint32_t), compareNumbers);
+    int unique = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (unique == 0 || (*keys)[unique - 1] != (*keys)[i])
+        {
+            (*keys)[unique++] = (*keys)[i];
+        }
+    }
+    return unique;
+}
+
+/*The purpose of this function is to add the hash of word and of the strings made by deleting at most left more characters of it.
+The characters are deleted from left to right (start is the first position that may be deleted),
+so every set of positions is deleted only once.*/
+void collectDeletes(const char *word, int length, int start, int left, uint32_t *keys, int *count)
+{
+    keys[(*count)++] = hashWord(word);
+    if (left == 0 || length == 0)
+    {
+        return;
+    }
+    char shorter[length];
+    for (int i = start; i < length; i++)
+    {
+        memcpy(shorter, word, i);
+        memcpy(shorter + i, word + i + 1, length - i); // with the '\0'
+        collectDeletes(shorter, length - 1, i, left - 1, keys, count);
+    }
+}
+
+/*The purpose of this function is to create the index for every word of the loaded dictionary and to publish it.*/
+void buildDeleteIndex(void)
+{
+    syncWriterVersion();
+    for (uint32_t i = 0; i < dict.count; i++)
+    {
+        addDeletes(i);
+    }
+    publishDictionary();
+}
+
+/*The purpose of this function is to put a dictionary word into the lists of all of its keys. Only the event loop calls it.*/
+void addDeletes(uint32_t index)
+{
+    uint32_t *keys;
+    int count = wordDeletes(dictionaryWord(index), dictionaryLength(index), &keys);
+    for (int i = 0; i < count; i++)
+    {
+        insertDelete(keys[i], index);
+    }
+    arenaReset(&scratch_arena);
+}
+
+/*The purpose of this function is to append a word number to the list of a key, the list is created if the key is new.
+When the table would be more than half full, the lists are moved into a table of twice the size; the lists themselves are not copied.
+When a list is full, a copy of twice the capacity replaces it. The replaced table or list is retired,
+unless no published version can see it yet (while the dictionary is loaded), then it is freed at once.*/
+void insertDelete(uint32_t key, uint32_t word)
+{
+    DictionaryVersion *published = atomic_load(&dictionary_version);
+
+    if (dict.deletes == NULL || (dict.delete_keys + 1) * 2 > dict.deletes->mask + 1)
+    {
+        uint32_t size = dict.deletes == NULL ? 1024 : (dict.deletes->mask + 1) * 2;
+        DeleteIndex *index = malloc(sizeof(DeleteIndex) + size * sizeof(DeleteSlot));
+        if (index == NULL)
+        {
+            perror("Error allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        index->mask = size - 1;
+        for (uint32_t i = 0; i < size; i++)
+        {
+            atomic_init(&index->slot[i].key, 0);
+            atomic_init(&index->slot[i].list, NULL);
+        }
+        if (dict.deletes != NULL)
+        {
+            for (uint32_t i = 0; i <= dict.deletes->mask; i++)
+            {
+                DeleteList *list = atomic_load_explicit(&dict.deletes->slot[i].list, memory_order_relaxed);
+                if (list == NULL)
+                {
+                    continue;
+                }
+                uint32_t moved = atomic_load_explicit(&dict.deletes->slot[i].key, memory_order_relaxed);
+                uint32_t j = moved & index->mask;
+                while (atomic_load_explicit(&index->slot[j].list, memory_order_relaxed) != NULL)
+                {
+                    j = (j + 1) & index->mask;
+                }
+                atomic_init(&index->slot[j].key, moved);
+                atomic_init(&index->slot[j].list, list);
+            }
+            if (published != NULL && published->deletes == dict.deletes)
+            {
+                retireMemory(dict.deletes);
+            }
+            else
+            {
+                free(dict.deletes);
+            }
+        }
+        dict.deletes = index;
+        writer_version.deletes = index;
+    }
+
+    uint32_t i = key & dict.deletes->mask;
+    DeleteSlot *slot;
+    DeleteList *list;
+    while (true)
+    {
+        slot = &dict.deletes->slot[i];
+        list = atomic_load_explicit(&slot->list, memory_order_relaxed);
+        if (list == NULL || atomic_load_explicit(&slot->key, memory_order_relaxed) == key)
+        {
+            break;
+        }
+        i = (i + 1) & dict.deletes->mask;
+    }
+
+    int count = list == NULL ? 0 : atomic_load_explicit(&list->count, memory_order_relaxed);
+    if (list == NULL || count == list->capacity)
+    {
+        int capacity = list == NULL ? 4 : list->capacity * 2;
+        DeleteList *grown = malloc(sizeof(DeleteList) + capacity * sizeof(uint32_t));
+        if (grown == NULL)
+        {
+            perror("Error allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        grown->capacity = capacity;
+        atomic_init(&grown->count, count);
+        if (list != NULL)
+        {
+            memcpy(grown->word, list->word, count * sizeof(uint32_t));
+            if (published != NULL && published->deletes != NULL)
+            {
+                retireMemory(list);
+            }
+            else
+            {
+                free(list);
+            }
+        }
+        else
+        {
+            atomic_store_explicit(&slot->key, key, memory_order_relaxed);
+            dict.delete_keys++;
+        }
+        list = grown;
+    }
+    list->word[count] = word;
+    atomic_store_explicit(&list->count, count + 1, memory_order_release);
+    atomic_store_explicit(&slot->list, list, memory_order_release);
+}
+
+/*The purpose of this function is to find the closest dictionary words of s1 with the symmetric delete index.
+The words in the lists of the keys of s1 are the candidates. They are sorted to visit every word once
+and checked with boundedLevenshtein with the bound symspell_distance.
+Every word with a difference of at most symspell_distance is a candidate, so if LEVENSHTEIN_LIST_LIMIT of them are found,
+no other word of the dictionary can be closer and the answer is the same as the answer of the BK-tree.
+Returns true if the result has been written, otherwise false and the caller searches the whole dictionary.*/
+bool searchDeletes(const char *s1, LevInfo *result)
+{
+    const DictionaryVersion *version = dictionaryVersion();
+    const DeleteIndex *index = version->deletes;
+    int len1 = strlen(s1);
+    int found = 0;
+    LevInfo heap[LEVENSHTEIN_LIST_LIMIT];
+
+    if (index == NULL)
+    {
+        return false;
+    }
+    uint32_t *keys;
+    int key_count = wordDeletes(s1, len1, &keys);
+    uint32_t *candidates = NULL;
+    int candidate_count = 0;
+    int candidate_capacity = 0;
+    for (int k = 0; k < key_count; k++)
+    {
+        for (uint32_t i = keys[k] & index->mask;; i = (i + 1) & index->mask)
+        {
+            const DeleteList *list = atomic_load_explicit(&index->slot[i].list, memory_order_acquire);
+            if (list == NULL)
+            {
+                break;
+            }
+            if (atomic_load_explicit(&index->slot[i].key, memory_order_relaxed) != keys[k])
+            {
+                continue;
+            }
+            int count = atomic_load_explicit(&list->count, memory_order_acquire);
+            if (candidate_count + count > candidate_capacity)
+            {
+                candidate_capacity = (candidate_count + count) * 2;
+                uint32_t *grown = arenaAlloc(&scratch_arena, candidate_capacity * sizeof(uint32_t));
+                if (candidate_count > 0)
+                {
+                    memcpy(grown, candidates, candidate_count * sizeof(uint32_t));
+                }
+                candidates = grown;
+            }
+            for (int j = 0; j < count; j++)
+            {
+                if (list->word[j] < version->count) // a word of a newer version
+                {
+                    candidates[candidate_count++] = list->word[j];
+                }
+            }
+            break;
+        }
+    }
+
+    if (candidate_count > 0)
+    {
+        qsort(candidates, candidate_count, sizeof(uint32_t), compareNumbers);
+    }
+    for (int i = 0; i < candidate_count; i++)
+    {
+        if (i > 0 && candidates[i] == candidates[i - 1])
+        {
+            continue;
+        }
+        int len2 = dictionaryLength(candidates[i]);
+        int diff = boundedLevenshtein(s1, len1, dictionaryWord(candidates[i]), len2, symspell_distance);
+        if (diff <= symspell_distance)
+        {
+            pushTopWord(heap, &found, candidates[i], diff);
+        }
+    }
+    arenaReset(&scratch_arena); // the keys and the candidates
+    if (found < LEVENSHTEIN_LIST_LIMIT)
+    {
+        return false;
+    }
+    TopWords(heap, found, result);
+    return true;
+}
+
+/*The purpose of this function is to release the index at the end. Every list is in the current table exactly once,
+the lists and tables that were replaced have already been retired.*/
+void freeDeleteIndex(void)
+{
+    if (dict.deletes == NULL)
+    {
+        return;
+    }
+    for (uint32_t i = 0; i <= dict.deletes->mask; i++)
+    {
+        free(atomic_load_explicit(&dict.deletes->slot[i].list, memory_order_relaxed));
+    }
+    free(dict.deletes);
+    dict.deletes = NULL;
+    dict.delete_keys = 0;
+    writer_version.deletes = NULL;
+}
+
+/*Compare method for TopWords.First,the method is checking for numbers.If the numbers are the same then it is checking for strings.*/
+int compareLevInfo(const void *a, const void *b)
+{
+    const LevInfo *infoA = (const LevInfo *)a;
+    const LevInfo *infoB = (const LevInfo *)b;
+
+    // Compare diff values first
+    if (infoA->diff < infoB->diff)
+    {
+        return -1; //
+    }
+    else if (infoA->diff > infoB->diff)
+    {
+        return 1;
+    }
+    else
+    {
+        // if diff is equal, sort by the words
+        if (infoA->word == infoB->word)
+        {
+            return 0;
+        }
+        return strcmp(dictionaryWord(infoA->word), dictionaryWord(infoB->word));
+    }
+}
+
+/*The purpose of the function is to take one line received via telnet.
+receiveInput collects the bytes of the client in the receive ring of the connection until the end of the line arrives,
+then this function is called. The input received is not separated into its parts in any way and is taken as is.
+Necessary error messages are set to the error_message of the connection based on the problems specified in the project document related to the input.*/
+/*The getInput function is also used for the answers of the questions,
+where the main purpose is to get the desired input from the user rather than returning error messages,
+so the error messages are related to the actual string received from the user.
+The line is not copied: it is ended in the receive ring itself and stays valid until processInput consumes it.*/
+char *getInput(Connection *conn, char *line, int length)
+{
+    /*In the usage function of telnet, it puts \r\n at the end of the sentence, which causes 2 more characters to be received from the typed text.
+    The \n at line[length] is replaced by the \0, and the \r is removed with the strscpn operation mentioned immediately 1 line below.
+    A line longer than the character limit is rejected by checkInput, or here if its beginning did not fit into the receive ring.*/
+    line[length] = '\0';
+    line[strcspn(line, "\r")] = '\0';
+
+    if (conn->input_overflow)
+    {
+        conn->error_message = "\nError: Input exceeds INPUT_CHARACTER_LIMIT characters.\n";
+        return line;
+    }
+    conn->error_message = checkInput(line);
+    return line;
+}
+
+/*The purpose of this function is to check a line against the rules of the project document.
+Returns the error message of the first broken rule, or NULL if the line is a valid input.
+It is used by getInput and by the batch protocol.*/
+const char *checkInput(const char *input)
+{
+    if (strlen(input) > INPUT_CHARACTER_LIMIT)
+    {
+        return "\nError: Input exceeds INPUT_CHARACTER_LIMIT characters.\n";
+    }
+    if (strlen(input) == 0)
+    {
+        return "\nError: Input is empty.\n";
+    }
+
+    // Invalid
+    for (int i = 0; input[i] != '\0'; i++)
+    {
+        /*The reason we accept '-' outside of the alphabet and spaces is that some words combine to create a different meaning.
+        Examples: fire-engine, well-known, well-being etc. but If the user writes hello-their-how-are-you or something, it will be perceived as a single word.*/
+        if (!isalpha((unsigned char)input[i]) && input[i] != ' ' && input[i] != '-') // Just alphabet characters or spaces or '-'
+        {
+            return "\nInvalid character is found\n";
+        }
+    }
+    return NULL;
+}
+
+/*The usage of this function is as follows. First of all, the purpose of the function is to create an array that will fit each text for a text with no specific number of lines.
+The array is first opened as 2 elements and then, after each incoming word, if the array is full, it doubles itself with realloc.*/
+void addString(char ***array, int *size, int *capacity, const char *newString)
+{
+    if (*size >= *capacity)
+    {
+        *capacity *= 2;
+        *array = realloc(*array, *capacity * sizeof(char *));
+        if (*array == NULL)
+        {
+            perror("Error reallocating memory");
+            exit(EXIT_FAILURE);
+        }
+    }
+    (*array)[*size] = strdup(newString);
+    if ((*array)[*size] == NULL)
+    {
+        perror("Error duplicating string");
+        exit(EXIT_FAILURE);
+    }
+    (*size)++;
+}
+
+// Free the memory allocated for the dynamic array
+void freeArray(char **array, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        free(array[i]);
+    }
+    free(array);
+}
+
+// Convert a string to lowercase
+void toLowerCase(char *str)
+{
+    for (int i = 0; str[i]; i++)
+    {
+        str[i] = tolower(str[i]);
+    }
+}
+
+/*The main purpose of this function is to separate the received input according to the gaps.
+The most important difference from normal separation is that it finds the repeated words.
+Example: hello ege abdullah ege hello hello.
+Yes, this example may not make sense.However, we may not know exactly what the user will write and the sentence he will write may contain repetitive words.
+If the user wants to add the first hello, the first hello state should appear in the Levensthein algorithm of the second hello.
+So for every word the position of its previous occurrence is kept in repeat_of, and the words are broken down as follows.
+hello:-1, ege:-1, abdullah:-1, ege:1, hello:0, hello:4
+The words are found with a small hash table in one pass, and they all point into one copy of the sentence in the arena of the client.*/
+void splitSentence(Connection *conn, const char *input)
+{
+    int capacity = strlen(input) / 2 + 1; // there is a space between two words
+    int slots = 1;
+    while (slots < 2 * capacity)
+    {
+        slots <<= 1;
+    }
+    int *last = arenaAlloc(&conn->arena, slots * sizeof(int)); // the last position of every word, by hash
+    conn->split_text = arenaCopy(&conn->arena, input, strlen(input));
+    conn->words = arenaAlloc(&conn->arena, capacity * sizeof(char *));
+    conn->repeat_of = arenaAlloc(&conn->arena, capacity * sizeof(int));
+    conn->added = arenaCalloc(&conn->arena, capacity, sizeof(bool));
+    for (int i = 0; i < slots; i++)
+    {
+        last[i] = -1;
+    }
+
+    conn->word_count = 0;
+    char *token = strtok(conn->split_text, " ");
+    while (token != NULL)
+    {
+        int position = conn->word_count++;
+        toLowerCase(token);
+        uint32_t i = hashWord(token) & (slots - 1);
+        while (last[i] >= 0 && strcmp(conn->words[last[i]], token) != 0)
+        {
+            i = (i + 1) & (slots - 1);
+        }
+        conn->words[position] = token;
+        conn->repeat_of[position] = last[i];
+        last[i] = position;
+        token = strtok(NULL, " ");
+    }
+}
+
+int compareWords(const void *a, const void *b) // compare two words according to their ascii code (letter by letter comparison case)
+{
+    const char *strA = *(const char **)a;
+    const char *strB = *(const char **)b;
+    return strcmp(strA, strB);
+}
+
+/*Compare method for sorting durations in increasing order.*/
+int compareSeconds(const void *a, const void *b)
+{
+    double secondsA = *(const double *)a;
+    double secondsB = *(const double *)b;
+    return (secondsA > secondsB) - (secondsA < secondsB);
+}
+
+/*Compare method for sorting 32-bit numbers (word numbers and hashes) in increasing order.*/
+int compareNumbers(const void *a, const void *b)
+{
+    uint32_t numberA = *(const uint32_t *)a;
+    uint32_t numberB = *(const uint32_t *)b;
+    return (numberA > numberB) - (numberA < numberB);
+}
+
+/*The order of the compiled dictionary: shorter words first, words of the same length alphabetically.*/
+int compareLengths(const void *a, const void *b)
+{
+    const char *s1 = *(const char **)a;
+    const char *s2 = *(const char **)b;
+    size_t len1 = strlen(s1);
+    size_t len2 = strlen(s2);
+    if (len1 != len2)
+    {
+        return len1 < len2 ? -1 : 1;
+    }
+    return strcmp(s1, s2);
+}
+
+/*This is an escape command. The purpose of this command is to clear the terminal when the user wants to enter input once more.*/
+void clearScreen(Connection *conn)
+{
+    char clear_cmd[] = "\033[H\033[J";
+    sendToClient(conn, clear_cmd);
+}
+
+/*The purpose of this function is to fill the global dictionary with the lines of the dictionary file.
+It is called only once when the server starts. The lines are read into a temporary array, packed into the arena by packDictionary
+and inserted into the BK-tree. The words that the users add later are appended by insertDictionaryWord.
+Returns 0 on success and -1 if the array could not be created or the file could not be opened.*/
+int loadDictionary(const char *path)
+{
+    char **words;
+    int size;
+
+    if (readDictionaryWords(path, &words, &size) != 0)
+    {
+        return -1;
+    }
+    buildDictionary(words, size);
+    freeArray(words, size);
+    return 0;
+}
+
+/*The purpose of this function is to make the global dictionary and its BK-tree from an array of words.
+A large dictionary of a server with more than one worker has no tree, it is scanned by all the workers together.*/
+void buildDictionary(char **words, int size)
+{
+    packDictionary(words, size);
+    if (parallel_scan && dict.base_count >= PARALLEL_SCAN_WORDS)
+    {
+        use_bk_tree = false;
+    }
+    if (use_bk_tree)
+    {
+        for (uint32_t i = 0; i < dict.count; i++)
+        {
+            insertBKTree(&bk_root, i);
+        }
+        reclaimMemory(); // the children lists that were replaced while the tree was built
+    }
+}
+
+/*The purpose of this function is to read the lines of a text dictionary into an array that grows with the addString function.
+Returns 0 on success and -1 if the array could not be created or the file could not be opened.*/
+int readDictionaryWords(const char *path, char ***words, int *size)
+{
+    FILE *dictionary;
+    char line[INPUT_CHARACTER_LIMIT + 1];
+    int capacity = 2;
+
+    *size = 0;
+    *words = malloc(capacity * sizeof(char *));
+    if (*words == NULL)
+    {
+        return -1;
+    }
+
+    if ((dictionary = fopen(path, "r")) == NULL)
+    {
+        free(*words);
+        *words = NULL;
+        return -1;
+    }
+
+    // Read dictionary words
+    while (fgets(line, sizeof(line), dictionary) != NULL)
+    {
+        line[strcspn(line, "\r\n")] = 0; // Remove newline character
+        toLowerCase(line);
+        addString(words, size, &capacity, line);
+    }
+    fclose(dictionary);
+    return 0;
+}
+
+/*The purpose of this function is to put the words of the dictionary file into the arena of the global dictionary.
+The words are sorted by length (compareLengths) and copied one after another, the number of the words of every length is counted
+into the buckets. The same layout is written to the compiled dictionary, so mapDictionary can use the file without changing it.*/
+void packDictionary(char **words, int size)
+{
+    uint32_t *offsets;
+    char *characters;
+    uint32_t total = 0;
+
+    uint8_t *lengths;
+
+    qsort(words, size, sizeof(char *), compareLengths);
+    memset(&dict, 0, sizeof(dict));
+    offsets = malloc((size + 1) * sizeof(uint32_t));
+    lengths = malloc(size > 0 ? size : 1);
+    if (offsets == NULL || lengths == NULL)
+    {
+        perror("Error allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < size; i++)
+    {
+        int length = strlen(words[i]);
+        offsets[i] = total;
+        total += length + 1;
+        lengths[i] = length;
+        dict.buckets[length + 1]++;
+    }
+    offsets[size] = total;
+    for (int l = 1; l <= INPUT_CHARACTER_LIMIT + 1; l++)
+    {
+        dict.buckets[l] += dict.buckets[l - 1]; // the number of words shorter than l
+    }
+    characters = malloc(total > 0 ? total : 1);
+    if (characters == NULL)
+    {
+        perror("Error allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < size; i++)
+    {
+        memcpy(characters + offsets[i], words[i], offsets[i + 1] - offsets[i]);
+    }
+    dict.base_characters = characters;
+    dict.base_offsets = offsets;
+    dict.base_lengths = lengths;
+    dict.base_count = size;
+    dict.count = size;
+    syncWriterVersion();
+    for (int i = 0; i < size; i++)
+    {
+        addMember(i);
+    }
+    publishDictionary();
+}
+
+/*The purpose of this function is to give the characters of a dictionary word from its number.
+The words of the dictionary file are in the base arena, the words added later in the arena of the version that is read.
+NO_WORD (an empty place of a result) is the empty string.*/
+const char *dictionaryWord(uint32_t index)
+{
+    if (index < dict.base_count)
+    {
+        return dict.base_characters + dict.base_offsets[index];
+    }
+    const DictionaryVersion *version = dictionaryVersion();
+    if (index < version->count)
+    {
+        return version->characters + version->offsets[index - dict.base_count];
+    }
+    return "";
+}
+
+/*The length of a dictionary word from its number.*/
+int dictionaryLength(uint32_t index)
+{
+    if (index < dict.base_count)
+    {
+        return dict.base_lengths[index];
+    }
+    return dictionaryVersion()->lengths[index - dict.base_count];
+}
+
+/*The version of the dictionary that the current thread reads. A worker reads the version that it took with readDictionary,
+the event loop is the only writer, so it reads its own view, which already contains the word that is being added.*/
+const DictionaryVersion *dictionaryVersion(void)
+{
+    if (reader_version != NULL)
+    {
+        return reader_version;
+    }
+    return &writer_version;
+}
+
+/*The purpose of this function is to make the words of the dictionary visible to the workers as a new version.
+The old version is retired, the workers that are still reading it keep it until they finish.*/
+void publishDictionary(void)
+{
+    DictionaryVersion *version = malloc(sizeof(DictionaryVersion));
+    if (version == NULL)
+    {
+        perror("Error allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    syncWriterVersion();
+    *version = writer_version;
+    DictionaryVersion *old = atomic_exchange_explicit(&dictionary_version, version, memory_order_acq_rel);
+    if (old != NULL)
+    {
+        retireMemory(old);
+    }
+}
+
+/*The purpose of this function is to bring the view of the event loop up to date with the arrays of the dictionary.*/
+void syncWriterVersion(void)
+{
+    writer_version.count = dict.count;
+    writer_version.characters = dict.characters;
+    writer_version.offsets = dict.offsets;
+    writer_version.lengths = dict.lengths;
+    writer_version.members = dict.members;
+    writer_version.deletes = dict.deletes;
+}
+
+// Word Set Informations
+
+/*The purpose of this function is to find a word in the dictionary version that the current thread reads.
+Returns the number of the word, or NO_WORD if it is not in the dictionary.*/
+uint32_t findWord(const char *word)
+{
+    const DictionaryVersion *version = dictionaryVersion();
+    const WordSet *set = version->members;
+    int length = strlen(word);
+
+    if (set == NULL)
+    {
+        return NO_WORD;
+    }
+    for (uint32_t i = hashWord(word) & set->mask;; i = (i + 1) & set->mask)
+    {
+        uint32_t index = atomic_load_explicit(&set->slot[i], memory_order_relaxed);
+        if (index == NO_WORD)
+        {
+            return NO_WORD;
+        }
+        if (index < version->count && dictionaryLength(index) == length && strcmp(dictionaryWord(index), word) == 0)
+        {
+            return index;
+        }
+    }
+}
+
+/*The purpose of this function is to put a dictionary word into the set, if the same word is not there yet.
+Only the event loop calls it. If the set would be more than half full, a set of twice the size is filled with the same numbers
+and the old set is retired, the workers that still read an old version keep using the old set.*/
+void addMember(uint32_t index)
+{
+    if (findWord(dictionaryWord(index)) != NO_WORD)
+    {
+        return;
+    }
+    if (dict.members == NULL || (dict.member_count + 1) * 2 > dict.members->mask + 1)
+    {
+        uint32_t size = 64;
+        while (size < (dict.member_count + 1) * 2)
+        {
+            size *= 2;
+        }
+        WordSet *set = malloc(sizeof(WordSet) + size * sizeof(uint32_t));
+        if (set == NULL)
+        {
+            perror("Error allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        set->mask = size - 1;
+        for (uint32_t i = 0; i < size; i++)
+        {
+            atomic_init(&set->slot[i], NO_WORD);
+        }
+        if (dict.members != NULL)
+        {
+            for (uint32_t i = 0; i <= dict.members->mask; i++)
+            {
+                uint32_t moved = atomic_load_explicit(&dict.members->slot[i], memory_order_relaxed);
+                if (moved == NO_WORD)
+                {
+                    continue;
+                }
+                uint32_t j = hashWord(dictionaryWord(moved)) & set->mask;
+                while (atomic_load_explicit(&set->slot[j], memory_order_relaxed) != NO_WORD)
+                {
+                    j = (j + 1) & set->mask;
+                }
+                atomic_init(&set->slot[j], moved);
+            }
+            // While the dictionary is loaded no version has the old set yet
+            DictionaryVersion *published = atomic_load(&dictionary_version);
+            if (published != NULL && published->members == dict.members)
+            {
+                retireMemory(dict.members);
+            }
+            else
+            {
+                free(dict.members);
+            }
+        }
+        dict.members = set;
+        writer_version.members = set;
+    }
+
+    uint32_t i = hashWord(dictionaryWord(index)) & dict.members->mask;
+    while (atomic_load_explicit(&dict.members->slot[i], memory_order_relaxed) != NO_WORD)
+    {
+        i = (i + 1) & dict.members->mask;
+    }
+    atomic_store_explicit(&dict.members->slot[i], index, memory_order_release);
+    dict.member_count++;
+}
+
+/*The result of a word whose closest words are not needed: the word itself with difference 0 if it is in the dictionary,
+otherwise an empty list. It has the same form as the result of a search, so the word is written in the same way.*/
+void membershipResult(uint32_t index, LevInfo *result)
+{
+    for (int i = 0; i < LEVENSHTEIN_LIST_LIMIT; i++)
+    {
+        result[i].word = NO_WORD;
+        result[i].diff = INT_MAX;
+    }
+    if (index != NO_WORD)
+    {
+        result[0].word = index;
+        result[0].diff = 0;
+    }
+}
+
+// Dictionary Reclamation Informations
+
+/*The workers never lock the dictionary. A worker announces the current epoch in its slot, takes the newest version
+and reads only that version until finishReading. When the event loop replaces a block (a version, the arrays of the added words
+or a children list of the BK-tree), the block is retired with the current epoch and the epoch is increased.
+A block retired in epoch e is freed when every worker is either not reading or announced an epoch after e:
+such a worker took its version after the block had been replaced, so it can not reach the block.*/
+
+/*The purpose of this function is to create one reader slot for every worker of the thread pool.*/
+void createReaderSlots(int count)
+{
+    reader_slots = calloc(count, sizeof(ReaderSlot));
+    if (reader_slots == NULL)
+    {
+        perror("Error allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    reader_slot_count = count;
+}
+
+/*The purpose of this function is to take the newest version of the dictionary for the current worker.
+The epoch is announced before the version is loaded (both sequentially consistent), so the event loop either sees the
+announcement or the worker sees the newer version.*/
+void readDictionary(void)
+{
+    if (worker_index >= 0 && worker_index < reader_slot_count)
+    {
+        atomic_store(&reader_slots[worker_index].epoch, atomic_load(&global_epoch));
+    }
+    reader_version = atomic_load(&dictionary_version);
+}
+
+/*The purpose of this function is to tell that the current worker does not read the dictionary anymore.*/
+void finishReading(void)
+{
+    reader_version = NULL;
+    if (worker_index >= 0 && worker_index < reader_slot_count)
+    {
+        atomic_store_explicit(&reader_slots[worker_index].epoch, 0, memory_order_release);
+    }
+}
+
+/*The purpose of this function is to put a block that is not reachable from the newest version anymore on the retired list.*/
+void retireMemory(void *pointer)
+{
+    RetiredBlock *block = malloc(sizeof(RetiredBlock));
+    if (block == NULL)
+    {
+        perror("Error allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    block->pointer = pointer;
+    block->epoch = atomic_load(&global_epoch);
+    block->next = retired_blocks;
+    retired_blocks = block;
+}
+
+/*The purpose of this function is to start a new epoch and to free the retired blocks that no worker can read anymore.*/
+void reclaimMemory(void)
+{
+    unsigned long oldest = ULONG_MAX;
+
+    atomic_fetch_add(&global_epoch, 1);
+    for (int i = 0; i < reader_slot_count; i++)
+    {
+        unsigned long epoch = atomic_load(&reader_slots[i].epoch);
+        if (epoch != 0 && epoch < oldest)
+        {
+            oldest = epoch;
+        }
+    }
+
+    RetiredBlock **link = &retired_blocks;
+    while (*link != NULL)
+    {
+        RetiredBlock *block = *link;
+        if (block->epoch < oldest)
+        {
+            *link = block->next;
+            free(block->pointer);
+            free(block);
+        }
+        else
+        {
+            link = &block->next;
+        }
+    }
+}
+
+/*The purpose of this function is to add a word that the user accepted to the dictionary.
+The workers that are reading the dictionary at that moment are not waited for, they continue with the version they took.
+The new word gets the number dict.count, so the results calculated before this moment can be brought up to date with refreshResult.
+The word is also given to the log of the dictionary, which writes it to the disk later, or to the supervisor in a worker process.*/
+void addDictionaryWord(const char *word)
+{
+    insertDictionaryWord(word);
+    reclaimMemory();
+    if (supervisor_socket != -1)
+    {
+        sendWordToSupervisor(word);
+    }
+    else
+    {
+        logDictionaryWord(word);
+    }
+}
+
+/*The purpose of this function is to append a word to the arena of the added words and to publish the new version.
+The word is written after the end of the arrays, where the readers of the old versions never look.
+When an array is full, a larger copy is made instead of realloc, because the old array can still be read; it is retired.
+The same word is inserted into the BK-tree, so the next Levenshtein calculation already sees it.*/
+void insertDictionaryWord(const char *word)
+{
+    size_t length = strlen(word);
+    uint32_t added = dict.count - dict.base_count;
+
+    if (dict.character_size + length + 1 > dict.character_capacity)
+    {
+        size_t capacity = dict.character_capacity == 0 ? 256 : dict.character_capacity;
+        while (capacity < dict.character_size + length + 1)
+        {
+            capacity *= 2;
+        }
+        char *temp = malloc(capacity);
+        if (temp == NULL)
+        {
+            perror("Error allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        if (dict.characters != NULL)
+        {
+            memcpy(temp, dict.characters, dict.character_size);
+            retireMemory(dict.characters);
+        }
+        dict.characters = temp;
+        dict.character_capacity = capacity;
+    }
+    if (added >= dict.added_capacity)
+    {
+        uint32_t capacity = dict.added_capacity == 0 ? 16 : dict.added_capacity * 2;
+        uint32_t *offsets = malloc(capacity * sizeof(uint32_t));
+        uint8_t *lengths = malloc(capacity * sizeof(uint8_t));
+        if (offsets == NULL || lengths == NULL)
+        {
+            perror("Error allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        if (dict.offsets != NULL)
+        {
+            memcpy(offsets, dict.offsets, added * sizeof(uint32_t));
+            memcpy(lengths, dict.lengths, added * sizeof(uint8_t));
+            retireMemory(dict.offsets);
+            retireMemory(dict.lengths);
+        }
+        dict.offsets = offsets;
+        dict.lengths = lengths;
+        dict.added_capacity = capacity;
+    }
+
+    memcpy(dict.characters + dict.character_size, word, length + 1);
+    dict.offsets[added] = dict.character_size;
+    dict.lengths[added] = length;
+    dict.character_size += length + 1;
+    dict.count++;
+
+    /*The word is put into the set and the tree before the version that contains it is published,
+    so a worker that reads the new version also finds the word in them.*/
+    syncWriterVersion();
+    addMember(dict.count - 1);
+    if (use_bk_tree)
+    {
+        insertBKTree(&bk_root, dict.count - 1);
+    }
+    if (dict.deletes != NULL)
+    {
+        addDeletes(dict.count - 1);
+    }
+    publishDictionary();
+}
+
+/*The purpose of this function is to map the compiled dictionary instead of loading the text file.
+The words are not copied: the base arena of the dictionary is the mapping itself and, if the file has one, the BK-tree is rebuilt from its nodes
+without calculating a single Levenshtein difference. The pages of the file are shared by every server process that maps it.
+Returns 0 on success and -1 if the file does not exist, is not valid or is older than the text file.*/
+int mapDictionary(const char *path, const char *source_path)
+{
+    struct stat source, compiled;
+    const DictionaryHeader *header;
+    const BKRecord *records = NULL;
+    BKNode **nodes = NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    if (fstat(fd, &compiled) == -1 || (size_t)compiled.st_size < sizeof(DictionaryHeader))
+    {
+        fprintf(stderr, "%s is not a valid compiled dictionary, %s is loaded instead\n", path, source_path);
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, compiled.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    /*Every offset of the file is checked before it is used, a broken file must not crash the server.*/
+    header = map;
+    size_t size = compiled.st_size;
+    uint64_t count = header->word_count;
+    if (memcmp(header->magic, COMPILED_DICTIONARY_MAGIC, sizeof(COMPILED_DICTIONARY_MAGIC)) != 0 ||
+        header->format_version != COMPILED_DICTIONARY_VERSION ||
+        header->offsets_offset + (count + 1) * sizeof(uint32_t) > size ||
+        header->buckets_offset + (INPUT_CHARACTER_LIMIT + 2) * sizeof(uint32_t) > size ||
+        (header->tree_offset != 0 && header->tree_offset + count * sizeof(BKRecord) > size) ||
+        (uint64_t)header->blob_offset + header->blob_size > size || header->blob_size == 0 ||
+        ((const char *)map)[header->blob_offset + header->blob_size - 1] != '\0' ||
+        header->offsets_offset % sizeof(uint32_t) != 0 || header->buckets_offset % sizeof(uint32_t) != 0 ||
+        header->tree_offset % sizeof(uint32_t) != 0)
+    {
+        fprintf(stderr, "%s is not a valid compiled dictionary, %s is loaded instead\n", path, source_path);
+        munmap(map, size);
+        return -1;
+    }
+    if (stat(source_path, &source) == 0 &&
+        ((uint32_t)source.st_size != header->source_size || (int64_t)source.st_mtime != header->source_time))
+    {
+        fprintf(stderr, "%s is older than %s, the text dictionary is loaded instead\n", path, source_path);
+        munmap(map, size);
+        return -1;
+    }
+
+    const uint32_t *offsets = (const uint32_t *)((const char *)map + header->offsets_offset);
+    const uint32_t *buckets = (const uint32_t *)((const char *)map + header->buckets_offset);
+    const char *blob = (const char *)map + header->blob_offset;
+    bool valid = buckets[0] == 0 && buckets[INPUT_CHARACTER_LIMIT + 1] == count && offsets[count] == header->blob_size;
+    for (uint32_t i = 0; valid && i < count; i++)
+    {
+        valid = offsets[i] < offsets[i + 1];
+    }
+    for (int l = 0; valid && l <= INPUT_CHARACTER_LIMIT; l++)
+    {
+        valid = buckets[l] <= buckets[l + 1];
+        for (uint32_t m = buckets[l]; valid && m < buckets[l + 1]; m++)
+        {
+            valid = offsets[m + 1] - offsets[m] == (uint32_t)l + 1 && blob[offsets[m + 1] - 1] == '\0';
+        }
+    }
+    if (valid && header->tree_offset != 0)
+    {
+        records = (const BKRecord *)((const char *)map + header->tree_offset);
+        for (uint32_t i = 0; valid && i < count; i++)
+        {
+            valid = records[i].word < count && (records[i].child_count == 0 ||
+                    (records[i].first_child > i && records[i].first_child + (uint64_t)records[i].child_count <= count));
+        }
+    }
+    if (!valid)
+    {
+        fprintf(stderr, "%s is not a valid compiled dictionary, %s is loaded instead\n", path, source_path);
+        munmap(map, size);
+        return -1;
+    }
+
+    uint8_t *lengths = malloc(count > 0 ? count : 1);
+    if (lengths == NULL)
+    {
+        munmap(map, size);
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        lengths[i] = offsets[i + 1] - offsets[i] - 1;
+    }
+    memset(&dict, 0, sizeof(dict));
+    dict.base_characters = blob;
+    dict.base_offsets = offsets;
+    dict.base_lengths = lengths;
+    dict.base_count = count;
+    dict.count = count;
+    memcpy(dict.buckets, buckets, sizeof(dict.buckets));
+    dict.mapping = map;
+    dict.mapping_size = size;
+    syncWriterVersion();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        addMember(i);
+    }
+    publishDictionary();
+
+    /*The nodes are created first, then every node takes its children from the consecutive nodes of the breadth-first order.*/
+    if (records != NULL && count > 0)
+    {
+        nodes = malloc(count * sizeof(BKNode *));
+        if (nodes == NULL)
+        {
+            perror("Error allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            nodes[i] = calloc(1, sizeof(BKNode));
+            if (nodes[i] == NULL)
+            {
+                perror("Error allocating memory");
+                exit(EXIT_FAILURE);
+            }
+            nodes[i]->word = records[i].word;
+            nodes[i]->length = lengths[records[i].word];
+            atomic_init(&nodes[i]->max_child_distance, records[i].max_child_distance);
+            atomic_init(&nodes[i]->children, NULL);
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (records[i].child_count == 0)
+            {
+                continue;
+            }
+            BKChildList *children = malloc(sizeof(BKChildList) + records[i].child_count * sizeof(BKChild));
+            if (children == NULL)
+            {
+                perror("Error allocating memory");
+                exit(EXIT_FAILURE);
+            }
+            children->count = records[i].child_count;
+            for (uint32_t k = 0; k < records[i].child_count; k++)
+            {
+                children->child[k].distance = records[records[i].first_child + k].parent_distance;
+                children->child[k].node = nodes[records[i].first_child + k];
+            }
+            atomic_init(&nodes[i]->children, children);
+        }
+        bk_root = nodes[0];
+        free(nodes);
+    }
+
+    use_bk_tree = records != NULL;
+    printf("The compiled dictionary %s is mapped (%u words)\n", path, dict.count);
+    return 0;
+}
+
+/*The purpose of this function is to create the compiled dictionary from the text dictionary.
+The dictionary is loaded exactly like the server loads it, and its arena is written as it is.
+The BK-tree is built once here and written node by node in breadth-first order, so the server does not build it again.
+The file is written under a temporary name and renamed, so a server that starts at the same time never maps half a file.
+Returns 0 on success and -1 on error.*/
+int compileDictionary(const char *source_path, const char *path, bool with_tree)
+{
+    FILE *dictionary;
+    char temporary_path[PATH_MAX];
+    struct stat source;
+    DictionaryHeader header;
+    BKRecord *records = NULL;
+
+    if (stat(source_path, &source) == -1)
+    {
+        return -1;
+    }
+    use_bk_tree = with_tree;
+    if (loadDictionary(source_path) != 0)
+    {
+        return -1;
+    }
+    uint32_t size = dict.count;
+    uint32_t blob_size = dict.base_offsets[size];
+
+    /*The breadth-first queue gives the number of every node: the children of a node are put into the queue together.*/
+    if (bk_root != NULL)
+    {
+        BKNode **queue = malloc(size * sizeof(BKNode *));
+        uint32_t head = 0, tail = 0;
+        records = calloc(size, sizeof(BKRecord));
+        if (queue == NULL || records == NULL)
+        {
+            perror("Error allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        queue[tail++] = bk_root;
+        while (head < tail)
+        {
+            BKNode *node = queue[head];
+            BKRecord *record = &records[head];
+            head++;
+            BKChildList *children = atomic_load(&node->children);
+            record->word = node->word;
+            record->max_child_distance = atomic_load(&node->max_child_distance);
+            record->first_child = tail;
+            record->child_count = children == NULL ? 0 : children->count;
+            for (uint32_t k = 0; k < record->child_count; k++)
+            {
+                records[tail].parent_distance = children->child[k].distance;
+                queue[tail++] = children->child[k].node;
+            }
+        }
+        free(queue);
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COMPILED_DICTIONARY_MAGIC, sizeof(COMPILED_DICTIONARY_MAGIC));
+    header.format_version = COMPILED_DICTIONARY_VERSION;
+    header.word_count = size;
+    header.offsets_offset = sizeof(header);
+    header.buckets_offset = header.offsets_offset + (size + 1) * sizeof(uint32_t);
+    header.tree_offset = records != NULL ? header.buckets_offset + sizeof(dict.buckets) : 0;
+    header.blob_offset = header.buckets_offset + sizeof(dict.buckets) + (records != NULL ? size * sizeof(BKRecord) : 0);
+    header.blob_size = blob_size;
+    header.source_size = source.st_size;
+    header.source_time = source.st_mtime;
+
+    snprintf(temporary_path, sizeof(temporary_path), "%s.tmp", path);
+    dictionary = fopen(temporary_path, "wb");
+    int result = dictionary == NULL ? -1 : 0;
+    if (dictionary != NULL)
+    {
+        if (fwrite(&header, sizeof(header), 1, dictionary) != 1 ||
+            fwrite(dict.base_offsets, sizeof(uint32_t), size + 1, dictionary) != (size_t)size + 1 ||
+            fwrite(dict.buckets, sizeof(dict.buckets), 1, dictionary) != 1 ||
+            (records != NULL && fwrite(records, sizeof(BKRecord), size, dictionary) != (size_t)size) ||
+            fwrite(dict.base_characters, 1, blob_size, dictionary) != blob_size)
+        {
+            result = -1;
+        }
+        if (fclose(dictionary) != 0 || result != 0 || rename(temporary_path, path) != 0)
+        {
+            unlink(temporary_path);
+            result = -1;
+        }
+    }
+    if (result == 0)
+    {
+        printf("%u words are compiled into %s%s\n", size, path, records != NULL ? " with the BK-tree" : "");
+    }
+
+    free(records);
+    freeBKTree(bk_root);
+    bk_root = NULL;
+    freeDictionary();
+    return result;
+}
+
+/*The purpose of this function is to release the dictionary at the end.
+The base arena is either unmapped at once or freed, the arena of the added words is always freed.*/
+void freeDictionary(void)
+{
+    if (dict.mapping != NULL)
+    {
+        munmap(dict.mapping, dict.mapping_size);
+    }
+    else
+    {
+        free((void *)dict.base_characters);
+        free((void *)dict.base_offsets);
+    }
+    free((void *)dict.base_lengths);
+    free(dict.characters);
+    free(dict.offsets);
+    free(dict.lengths);
+    free(dict.members);
+    free(atomic_exchange(&dictionary_version, NULL));
+    memset(&dict, 0, sizeof(dict));
+    memset(&writer_version, 0, sizeof(writer_version));
+}
+
+// Dictionary Log Informations
+
+/*The dictionary file is not rewritten for every word that a user adds. The word is appended to the log of the dictionary,
+and the flusher thread writes the log to the disk: the event loop only copies the word into memory and never waits for the disk.
+Every fsync of the flusher makes all the words durable that were added while the previous one was running (group commit).
+When the log has LOG_COMPACT_WORDS words, the flusher writes the dictionary file again with them in sorted order and empties the log.
+When the server starts, the words of the log are added to the dictionary that was loaded from the file, so no word is lost
+if the server stops at any moment, even in the middle of a write.*/
+
+/*The purpose of this function is to open the log of the dictionary and to start its flusher thread if with_flusher is true,
+otherwise the owner of the log calls writePendingWords itself.
+The words that are in the log already are added to the dictionary first (replayDictionaryLog).
+Returns 0 on success and -1 if the file could not be opened or the thread could not be created.*/
+int openDictionaryLog(const char *path, bool with_flusher)
+{
+    int replayed;
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+
+    if (fd == -1)
+    {
+        return -1;
+    }
+    replayed = replayDictionaryLog(fd);
+    if (replayed < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    pthread_mutex_init(&dictionary_log.mutex, NULL);
+    pthread_cond_init(&dictionary_log.cond, NULL);
+    dictionary_log.fd = fd;
+    dictionary_log.logged_words = replayed;
+    if (with_flusher && pthread_create(&dictionary_log.thread, NULL, flushDictionaryLog, NULL) != 0)
+    {
+        pthread_mutex_destroy(&dictionary_log.mutex);
+        pthread_cond_destroy(&dictionary_log.cond);
+        close(fd);
+        dictionary_log.fd = -1;
+        return -1;
+    }
+    dictionary_log.started = true;
+    dictionary_log.flusher = with_flusher;
+    return 0;
+}
+
+/*The purpose of this function is to add the words of the log to the dictionary when the server starts.
+A word that is already in the dictionary was moved into the dictionary file by a compaction that stopped before it emptied the log, it is skipped.
+A last line without a newline was being written when the server stopped: it is cut off, so the next word starts on a line of its own.
+Returns the number of the words in the log, or -1 on error.*/
+int replayDictionaryLog(int fd)
+{
+    char line[INPUT_CHARACTER_LIMIT + 3];
+    off_t complete = 0; // the end of the last whole line
+    int count = 0;
+    int copy = dup(fd);
+    FILE *log = copy == -1 ? NULL : fdopen(copy, "r");
+
+    if (log == NULL)
+    {
+        if (copy != -1)
+        {
+            close(copy);
+        }
+        return -1;
+    }
+    while (fgets(line, sizeof(line), log) != NULL)
+    {
+        size_t length = strlen(line);
+        if (line[length - 1] != '\n')
+        {
+            break;
+        }
+        complete += length;
+        line[length - 1] = '\0';
+        if (line[0] != '\0' && findWord(line) == NO_WORD)
+        {
+            insertDictionaryWord(line);
+        }
+        count++;
+    }
+    fclose(log);
+    reclaimMemory();
+
+    if (ftruncate(fd, complete) == -1)
+    {
+        return -1;
+    }
+    return count;
+}
+
+/*The purpose of this function is to give a word that was added to the dictionary to the flusher thread.
+It is called by the event loop, which only copies the word and wakes the flusher up.*/
+void logDictionaryWord(const char *word)
+{
+    DictionaryLog *log = &dictionary_log;
+    size_t length = strlen(word);
+
+    if (!log->started)
+    {
+        return; // the benchmark adds words without a log
+    }
+    pthread_mutex_lock(&log->mutex);
+    if (log->pending_size + length + 1 > log->pending_capacity)
+    {
+        size_t capacity = log->pending_capacity == 0 ? 256 : log->pending_capacity;
+        while (capacity < log->pending_size + length + 1)
+        {
+            capacity *= 2;
+        }
+        char *temp = realloc(log->pending, capacity);
+        if (temp == NULL)
+        {
+            perror("Error reallocating memory");
+            exit(EXIT_FAILURE);
+        }
+        log->pending = temp;
+        log->pending_capacity = capacity;
+    }
+    memcpy(log->pending + log->pending_size, word, length);
+    log->pending[log->pending_size + length] = '\n';
+    log->pending_size += length + 1;
+    log->pending_words++;
+    pthread_cond_signal(&log->cond);
+    pthread_mutex_unlock(&log->mutex);
+}
+
+/*This is the function of the flusher thread. It sleeps until a word is waiting and writes the words with writePendingWords.
+When the server stops, the remaining words are written and the log is moved into the dictionary file.*/
+void *flushDictionaryLog(void *arg)
+{
+    DictionaryLog *log = &dictionary_log;
+    (void)arg;
+
+    pthread_mutex_lock(&log->mutex);
+    while (true)
+    {
+        while (log->pending_size == 0 && !log->stopping)
+        {
+            pthread_cond_wait(&log->cond, &log->mutex);
+        }
+        if (log->pending_size == 0)
+        {
+            break;
+        }
+        pthread_mutex_unlock(&log->mutex);
+        writePendingWords();
+        pthread_mutex_lock(&log->mutex);
+    }
+    pthread_mutex_unlock(&log->mutex);
+
+    if (log->logged_words > 0 && compactDictionary(DICTIONARY_FILE) != 0)
+    {
+        perror("The dictionary could not be compacted");
+    }
+    return NULL;
+}
+
+/*The purpose of this function is to write all the words that are waiting at once. The two buffers are swapped,
+so the words are written to the end of the log and waited for with one fsync while new words fill the other buffer.
+A write that fails is cut off from the file, so the log never has half a word in the middle.
+Only the owner of the log calls it: the flusher thread, or the supervisor of --processes.*/
+void writePendingWords(void)
+{
+    DictionaryLog *log = &dictionary_log;
+
+    pthread_mutex_lock(&log->mutex);
+    char *buffer = log->writing;
+    size_t capacity = log->writing_capacity;
+    size_t size = log->pending_size;
+    int words = log->pending_words;
+    log->writing = log->pending;
+    log->writing_capacity = log->pending_capacity;
+    log->pending = buffer;
+    log->pending_capacity = capacity;
+    log->pending_size = 0;
+    log->pending_words = 0;
+    pthread_mutex_unlock(&log->mutex);
+    if (size == 0)
+    {
+        return;
+    }
+
+    off_t end = lseek(log->fd, 0, SEEK_END);
+    if (writeAll(log->fd, log->writing, size) != 0 || fdatasync(log->fd) != 0)
+    {
+        perror("The dictionary log could not be written");
+        if (end != -1 && ftruncate(log->fd, end) == -1)
+        {
+            perror("The dictionary log could not be repaired");
+        }
+    }
+    else
+    {
+        log->logged_words += words;
+    }
+    if (log->logged_words >= LOG_COMPACT_WORDS && compactDictionary(DICTIONARY_FILE) != 0)
+    {
+        perror("The dictionary could not be compacted");
+    }
+}
+
+/*The purpose of this function is to write a whole buffer to a file, because write can write only a part of it.
+Returns 0 on success and -1 on error.*/
+int writeAll(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = write(fd, data, size);
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        data += written;
+        size -= written;
+    }
+    return 0;
+}
+
+/*The purpose of this function is to move the words of the log into the dictionary file, in the flusher thread.
+The words of the dictionary file and of the log are sorted into a temporary file, which is written to the disk and renamed over the dictionary file.
+Only then the log is emptied: after a crash before the rename the old file and the whole log are still there,
+after a crash before the log is emptied its words are already in the dictionary, and replayDictionaryLog skips them.
+Returns 0 on success and -1 on error, the log is kept then.*/
+int compactDictionary(const char *path)
+{
+    FILE *dictionary;
+    char temporary_path[PATH_MAX];
+    char directory[PATH_MAX];
+    char **words, **logged;
+    int size, logged_size;
+    int result = 0;
+
+    if (readDictionaryWords(path, &words, &size) != 0)
+    {
+        return -1;
+    }
+    if (readDictionaryWords(DICTIONARY_LOG_FILE, &logged, &logged_size) != 0)
+    {
+        freeArray(words, size);
+        return -1;
+    }
+    char **temp = realloc(words, (size + logged_size + 1) * sizeof(char *));
+    if (temp == NULL)
+    {
+        perror("Error reallocating memory");
+        exit(EXIT_FAILURE);
+    }
+    words = temp;
+    memcpy(words + size, logged, logged_size * sizeof(char *));
+    free(logged);
+    size += logged_size;
+    qsort(words, size, sizeof(char *), compareWords);
+
+    snprintf(temporary_path, sizeof(temporary_path), "%s.tmp", path);
+    dictionary = fopen(temporary_path, "w");
+    if (dictionary == NULL)
+    {
+        freeArray(words, size);
+        return -1;
+    }
+    for (int i = 0; i < size; i++)
+    {
+        if (words[i][0] != '\0' && (i == 0 || strcmp(words[i], words[i - 1]) != 0))
+        {
+            fprintf(dictionary, "%s\n", words[i]);
+        }
+    }
+    if (fflush(dictionary) != 0 || fsync(fileno(dictionary)) != 0)
+    {
+        result = -1;
+    }
+    if (fclose(dictionary) != 0 || result != 0 || rename(temporary_path, path) != 0)
+    {
+        unlink(temporary_path);
+        freeArray(words, size);
+        return -1;
+    }
+    freeArray(words, size);
+
+    /*The new name is written to the disk with the directory, otherwise the old file could come back after a crash.*/
+    snprintf(directory, sizeof(directory), "%s", path);
+    char *slash = strrchr(directory, '/');
+    if (slash == NULL)
+    {
+        snprintf(directory, sizeof(directory), ".");
+    }
+    else
+    {
+        slash[slash == directory ? 1 : 0] = '\0';
+    }
+    int directory_fd = open(directory, O_RDONLY | O_DIRECTORY);
+    if (directory_fd == -1 || fsync(directory_fd) != 0)
+    {
+        result = -1;
+    }
+    if (directory_fd != -1)
+    {
+        close(directory_fd);
+    }
+    if (result != 0 || ftruncate(dictionary_log.fd, 0) != 0 || fdatasync(dictionary_log.fd) != 0)
+    {
+        return -1;
+    }
+    dictionary_log.logged_words = 0;
+    if (recompileDictionary(path, COMPILED_DICTIONARY_FILE) != 0)
+    {
+        perror("The compiled dictionary could not be made again");
+    }
+    return 0;
+}
+
+/*The purpose of this function is to compile the dictionary again after the text file was replaced by a compaction.
+The compiled dictionary keeps the size and the time of the text file, so otherwise the next start would find it out of date
+and parse the text file from then on. It is compiled by a new process of this program with --compile-dictionary,
+with the BK-tree if the old compiled dictionary had one, and renamed over the old one, so a server that maps it
+at the same time never sees half a file. Nothing is done if there is no compiled dictionary.
+Returns 0 on success and -1 on error, the text file is loaded at the next start then.*/
+int recompileDictionary(const char *source_path, const char *path)
+{
+    extern char **environ;
+    DictionaryHeader header;
+    char *arguments[6];
+    int count = 0;
+    pid_t pid;
+    int status;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        return errno == ENOENT ? 0 : -1;
+    }
+    bool with_tree = read(fd, &header, sizeof(header)) != sizeof(header) || header.tree_offset != 0;
+    close(fd);
+
+    arguments[count++] = "server";
+    arguments[count++] = "--compile-dictionary";
+    if (!with_tree)
+    {
+        arguments[count++] = "--no-tree";
+    }
+    arguments[count++] = (char *)source_path;
+    arguments[count++] = (char *)path;
+    arguments[count] = NULL;
+    errno = posix_spawn(&pid, "/proc/self/exe", NULL, NULL, arguments, environ);
+    if (errno != 0)
+    {
+        return -1;
+    }
+    while (waitpid(pid, &status, 0) == -1)
+    {
+        if (errno != EINTR)
+        {
+            return -1;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+/*The purpose of this function is to close the log when the server stops.
+The words that are still waiting are written and the log is compacted before it is closed, by the flusher thread if there is one.*/
+void closeDictionaryLog(void)
+{
+    DictionaryLog *log = &dictionary_log;
+
+    if (!log->started)
+    {
+        return;
+    }
+    if (log->flusher)
+    {
+        pthread_mutex_lock(&log->mutex);
+        log->stopping = true;
+        pthread_cond_signal(&log->cond);
+        pthread_mutex_unlock(&log->mutex);
+        pthread_join(log->thread, NULL);
+    }
+    else
+    {
+        writePendingWords();
+        if (log->logged_words > 0 && compactDictionary(DICTIONARY_FILE) != 0)
+        {
+            perror("The dictionary could not be compacted");
+        }
+    }
+
+    pthread_mutex_destroy(&log->mutex);
+    pthread_cond_destroy(&log->cond);
+    free(log->pending);
+    free(log->writing);
+    close(log->fd);
+    memset(log, 0, sizeof(DictionaryLog));
+    log->fd = -1;
+}
+
+// Worker Process Informations
+
+/*With --processes the clients are served by several processes instead of one. The supervisor loads the dictionary once
+and forks the workers, so every worker reads the same pages of the dictionary, its BK-tree and its index: a compiled dictionary
+is the same mapping of the file in all of them, and a parsed one is shared by fork until a worker adds a word.
+A word that a client adds is added by its worker at once and sent to the supervisor, the only process that writes the dictionary file.
+The supervisor adds the word to its own dictionary, so a worker that is started later already has it, and publishes it to every worker.
+The supervisor has no other thread, it forks the workers: it writes the log of the dictionary itself after every iteration of its loop.
+A worker returns from runSupervisor to main when its event loop has stopped, and releases the dictionary like a single server does.*/
+
+/*The purpose of this function is to run the supervisor of --processes. It starts count worker processes,
+publishes the words that they send and starts a worker again when it stops.
+When the server is stopped, the workers are stopped as well and waited for.
+Returns 0 when the server has stopped and 1 if it could not start.*/
+int runSupervisor(int count)
+{
+    struct epoll_event events[MAX_EVENTS];
+    int status;
+    pid_t pid;
+
+    workers = calloc(count, sizeof(WorkerProcess));
+    if (workers == NULL)
+    {
+        perror("Error allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    supervisor_epoll = epoll_create1(0);
+    if (supervisor_epoll == -1)
+    {
+        perror("epoll_create1 failed");
+        free(workers);
+        return 1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        workers[i].socket = -1;
+    }
+    for (int i = 0; i < count && server_running; i++)
+    {
+        int started = startWorker(i);
+        if (started == 1)
+        {
+            return serveClients(); // this is the new worker
+        }
+        if (started != 0)
+        {
+            perror("The worker process could not be started");
+            server_running = 0;
+        }
+    }
+
+    while (server_running)
+    {
+        int ready = epoll_wait(supervisor_epoll, events, MAX_EVENTS, SWEEP_INTERVAL_MS);
+        for (int i = 0; i < ready; i++)
+        {
+            WorkerProcess *worker = (WorkerProcess *)events[i].data.ptr;
+            if (worker->socket != -1 && (events[i].events & EPOLLOUT))
+            {
+                worker->blocked = false;
+                if (flushWorkerBacklog(worker) < 0)
+                {
+                    stopWorker(worker);
+                    continue;
+                }
+                if (!worker->blocked)
+                {
+                    updateWorkerEvents(worker); // the backlog is written, the socket is only read again
+                }
+            }
+            if (worker->socket != -1 && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) &&
+                receiveWords(worker->socket, worker->buffer, &worker->size, sizeof(worker->buffer), publishWord) < 0)
+            {
+                stopWorker(worker); // the worker has closed its end, it has crashed
+            }
+        }
+        writePendingWords(); // the words published by this iteration, with one fsync
+
+        /*A worker that has stopped is started again. Only its own clients have lost their sessions.*/
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                if (workers[i].pid == pid)
+                {
+                    fprintf(stderr, "Worker process %d has stopped, it is started again\n", i);
+                    workers[i].pid = 0;
+                    stopWorker(&workers[i]);
+                }
+            }
+        }
+        for (int i = 0; i < count && server_running; i++)
+        {
+            if (workers[i].pid != 0 || monotonicSeconds() < workers[i].started + WORKER_RESTART_SECONDS)
+            {
+                continue;
+            }
+            int started = startWorker(i);
+            if (started == 1)
+            {
+                return serveClients();
+            }
+            if (started != 0)
+            {
+                perror("The worker process could not be started");
+            }
+        }
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        if (workers[i].pid > 0)
+        {
+            kill(workers[i].pid, SIGTERM);
+        }
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (workers[i].pid > 0)
+        {
+            waitpid(workers[i].pid, &status, 0);
+            workers[i].pid = 0;
+        }
+        stopWorker(&workers[i]);
+        free(workers[i].backlog);
+    }
+    close(supervisor_epoll);
+    free(workers);
+    workers = NULL;
+    return 0;
+}
+
+/*The purpose of this function is to fork a worker process with its socket pair.
+The worker keeps only its own end of the pair, the log of the dictionary stays with the supervisor.
+With --stats-file every worker writes its own statistics, to the file name followed by the number of the worker.
+Returns 0 in the supervisor on success, -1 on error and 1 in the new worker, which serves the clients then.*/
+int startWorker(int number)
+{
+    WorkerProcess *worker = &workers[number];
+    struct epoll_event event;
+    int pair[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1)
+    {
+        return -1;
+    }
+    worker->started = monotonicSeconds();
+    fflush(NULL); // otherwise the worker writes the buffered output of the supervisor once more
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        close(pair[0]);
+        close(pair[1]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        for (int i = 0; i < worker_processes; i++)
+        {
+            if (workers[i].socket != -1)
             {
-                fprintf(dictionary, "%s\n", dict_array[j]);
+                close(workers[i].socket);
             }
-            fclose(dictionary);
+            free(workers[i].backlog);
         }
-        free(Output_String);
-        freeArrayList(array_list, sizes, numberofArrays);
-        freeArray(dict_array, arraySize);
-
-        /*The user can choose whether or not to enter another input.*/
-        message = "\n\nWould you like to enter another input?(y|Y):";
-        write(new_socket, message, strlen(message));
-        input = getInput(new_socket);
-        toLowerCase(input);
-        if (strcmp(input, "y") != 0)
-        {
-            message = "\nNo other input will be received";
-            write(new_socket, message, strlen(message));
-            free(input);
-            break;
+        close(pair[0]);
+        close(supervisor_epoll);
+        close(dictionary_log.fd);
+        dictionary_log.started = false; // the log belongs to the supervisor
+        free(workers);
+        workers = NULL;
+        supervisor_socket = pair[1];
+        if (stats_file != NULL)
+        {
+            snprintf(worker_stats_file, sizeof(worker_stats_file), "%s.%d", stats_file, number);
+            stats_file = worker_stats_file;
         }
-        free(input);
-        sleep(1);
-        clearScreen(new_socket);
+        return 1;
     }
-    message = "\n\nThank you for using Text Analysis Server! Good Bye!\n\n";
-    pthread_mutex_destroy(&mutex);
-    pthread_cond_destroy(&cond);
-    printf("%s\n", "The user's work is done");
-    write(new_socket, message, strlen(message));
-
-    close(new_socket);
-    close(socket_desc);
 
+    close(pair[1]);
+    fcntl(pair[0], F_SETFL, O_NONBLOCK);
+    worker->pid = pid;
+    worker->socket = pair[0];
+    worker->size = 0;
+    event.events = EPOLLIN;
+    event.data.ptr = worker;
+    if (epoll_ctl(supervisor_epoll, EPOLL_CTL_ADD, worker->socket, &event) == -1)
+    {
+        stopWorker(worker);
+        return -1;
+    }
     return 0;
 }
 
-// Thread Function Informations
-
-/*This is the most important part of the code. This is the desired function during the thread creation phase.
-First, regardless of the number of threads sent, Levenshtein values ​​are calculated first without entering
-the mutex structure and this value is thrown into an array. Then, the mutex structure is used.
-The mutex structure allows only and only 1 thread to enter during the specified intervals (lock, unlock).
-Unlike this event, the condition state is provided with the global variable turn and the id sent to the function.
-Thus, the threads are allowed to enter the critical region state according to their formation order.*/
-
-/*The response information of the elements entered in order is printed in a way that it will be the same as the given document.
-The snprintf structure is very important here. Whether or not each word written by the user is in the dictionary is done by looking
-at the first element of the array formed by the Levensthein function. As stated above, if the user has entered the input correctly,
-no matter what happens, the user is asked again if they enter a wrong word (do you want to add it to the dictionary).
-And according to the specified conditions, it is either added to the dictionary or not.*/
-
-/*While adding or not adding to the Dictionary,
-the user's current output status is created at the same time and sent to the function called MakeOutputString.*/
-void *threadFunction(void *arg)
+/*The purpose of this function is to close the socket of a worker and to kill the worker if it is still running.
+runSupervisor waits for it and starts it again. The socket is removed from epoll first, because a worker that is being forked
+can still have a copy of it.*/
+void stopWorker(WorkerProcess *worker)
 {
-    ThreadData *data = (ThreadData *)arg;
-    LevInfo *result = calculateLevenshtein(data->word);
-    int thread_id = data->id;
-    int socket = data->socket;
-    pthread_mutex_lock(&mutex);
-    while (turn != thread_id)
+    if (worker->socket != -1)
     {
-        pthread_cond_wait(&cond, &mutex); // Thread waits in queue
+        epoll_ctl(supervisor_epoll, EPOLL_CTL_DEL, worker->socket, NULL);
+        close(worker->socket);
+        worker->socket = -1;
     }
-    // sleep(1);
-    // The buffer required to print the specified text outside the output string.
-    char *buffer = (char *)malloc(BUFFER_SIZE * sizeof(char));
-    int offset = 0;
-    char *input = NULL;
-
-    snprintf(buffer, BUFFER_SIZE, "\nWORD %02d: %s\n", thread_id, data->word);
-    write(socket, buffer, strlen(buffer));
-
-    offset += snprintf(buffer + offset, BUFFER_SIZE - offset, "MATCHES: ");
-    for (int i = 0; i < LEVENSHTEIN_LIST_LIMIT; i++)
+    if (worker->pid > 0)
     {
-        // Print each element (word and diff)
-        offset += snprintf(buffer + offset, BUFFER_SIZE - offset, "%s (%d)", result[i].stringName, result[i].diff);
-
-        // Let's add a comma before the next element, but not after the last element
-        if (i < LEVENSHTEIN_LIST_LIMIT - 1)
-        {
-            offset += snprintf(buffer + offset, BUFFER_SIZE - offset, ", ");
-        }
+        kill(worker->pid, SIGKILL);
     }
-    offset += snprintf(buffer + offset, BUFFER_SIZE - offset, "\n");
-    write(socket, buffer, strlen(buffer));
-
-    // This status has been reset because the status of the threads could not be fully estimated.
-    offset = 0;
+    worker->backlog_length = 0; // the new worker gets the whole dictionary, the blocks of the backlog are kept
+    worker->backlog_sent = 0;
+    worker->blocked = false;
+}
 
-    // check dictionary situation
-    /*If the word is in the dictionary, it is written directly to the output as it is.
-    If the word is not in the dictionary, there are 2 situations. Requesting and not requesting the addition.
-    If the user adds the word, the word is added to the dictionary and written to the output string as it is.
-    If the user does not want it, the closest word to it is added to the output string.*/
-    // The process continues until y\n or empty response is received.
-    if (result[0].diff == 0)
+/*The purpose of this function is to add published words to the backlog of a worker, like sendBytesToClient for a client.*/
+void queueWorkerWords(WorkerProcess *worker, const char *line, int length)
+{
+    if (worker->backlog_sent > 0 && worker->backlog_length + length > worker->backlog_capacity)
     {
-        snprintf(buffer, 132, "WORD %s is present in dictionary\n", data->word);
-        write(socket, buffer, strlen(buffer));
-        MakeOutputString(thread_id, data->word);
+        // The written part of the backlog is dropped before the buffer is made larger
+        memmove(worker->backlog, worker->backlog + worker->backlog_sent, worker->backlog_length - worker->backlog_sent);
+        worker->backlog_length -= worker->backlog_sent;
+        worker->backlog_sent = 0;
     }
-    else
+    if (worker->backlog_length + length > worker->backlog_capacity)
     {
-        snprintf(buffer, 136, "WORD %s is not present in dictionary\n", data->word);
-        write(socket, buffer, strlen(buffer));
-        snprintf(buffer, 51, "Do you want to add this word to dictionary? (y/N):");
-        write(socket, buffer, strlen(buffer));
-        input = getInput(socket);
-        bool flag = true;
-        toLowerCase(input);
-        if (strlen(input) == 0 || strcmp(input, "n") == 0)
+        size_t capacity = worker->backlog_capacity == 0 ? BUFFER_SIZE : worker->backlog_capacity;
+        while (capacity < worker->backlog_length + length)
         {
-            MakeOutputString(thread_id, result[0].stringName);
+            capacity *= 2;
         }
-        else if (strcmp(input, "y") == 0)
+        char *temp = realloc(worker->backlog, capacity);
+        if (temp == NULL)
         {
-            MakeOutputString(thread_id, data->word);
-            addString(&dict_array, &arraySize, &arrayCapacity, data->word);
+            perror("Error reallocating memory");
+            exit(EXIT_FAILURE);
         }
-        else
+        worker->backlog = temp;
+        worker->backlog_capacity = capacity;
+    }
+    memcpy(worker->backlog + worker->backlog_length, line, length);
+    worker->backlog_length += length;
+}
+
+/*The purpose of this function is to write the backlog of a worker, like flushPendingOutput for a client.
+If the socket takes only a part of it, the worker is blocked and the socket is watched until it is writable.
+Returns -1 if the worker is gone and 0 otherwise (also when only a part of the backlog could be written).*/
+int flushWorkerBacklog(WorkerProcess *worker)
+{
+    while (worker->backlog_sent < worker->backlog_length)
+    {
+        ssize_t result = write(worker->socket, worker->backlog + worker->backlog_sent, worker->backlog_length - worker->backlog_sent);
+        if (result < 0)
         {
-            while (flag == true)
+            if (errno == EINTR)
             {
-                snprintf(buffer, 38, "Wrong Input Please Enter Again (y/N):");
-                write(socket, buffer, strlen(buffer));
-                input = getInput(socket);
-                toLowerCase(input);
-                if (strlen(input) == 0 || strcmp(input, "n") == 0)
-                {
-                    flag = false;
-                    MakeOutputString(thread_id, result[0].stringName);
-                }
-                else if (strcmp(input, "y") == 0)
-                {
-                    flag = false;
-                    MakeOutputString(thread_id, data->word);
-                    addString(&dict_array, &arraySize, &arrayCapacity, data->word);
-                }
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                worker->blocked = true;
+                updateWorkerEvents(worker);
+                return 0;
             }
+            return -1;
         }
+        worker->backlog_sent += result;
     }
-    free(input);
-    free(result);
-    free(buffer);
-    turn++; // Move to next thread
-    pthread_cond_broadcast(&cond);
+    worker->backlog_length = 0;
+    worker->backlog_sent = 0;
+    return 0;
+}
 
-    pthread_mutex_unlock(&mutex);
+/*The socket of a worker is always read, and it is only watched for writing while its backlog waits for it.*/
+void updateWorkerEvents(WorkerProcess *worker)
+{
+    struct epoll_event event;
+    event.events = worker->blocked ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    event.data.ptr = worker;
+    epoll_ctl(supervisor_epoll, EPOLL_CTL_MOD, worker->socket, &event);
 }
 
-/*The purpose of this function is to create the output properly.
-The reason for writing Output_character_limit+2 is stated above. (To provide the max character requirement as min.)*/
-void MakeOutputString(int thread_id, char *word)
+/*The purpose of this function is to read the words that arrive on a socket pair of --processes, one on every line,
+and to give every complete word to addWord. The beginning of a word whose end has not arrived yet stays in the buffer.
+Returns 0, or -1 when the other process has closed its end.*/
+int receiveWords(int fd, char *buffer, int *size, int capacity, void (*addWord)(const char *word))
 {
-    if (thread_id == 1)
+    char received[BUFFER_SIZE * 16];
+    ssize_t length = read(fd, received, sizeof(received));
+
+    if (length == 0)
     {
-        output_offset += snprintf(Output_String + output_offset, OUTPUT_CHARACTER_LIMIT + 2 - output_offset, "%s", word);
+        return -1;
     }
-    else
+    if (length == -1)
+    {
+        return errno == EINTR || errno == EAGAIN ? 0 : -1;
+    }
+    for (ssize_t i = 0; i < length; i++)
     {
-        output_offset += snprintf(Output_String + output_offset, OUTPUT_CHARACTER_LIMIT + 2 - output_offset, " %s", word);
+        if (received[i] != '\n')
+        {
+            if (*size < capacity - 1)
+            {
+                buffer[(*size)++] = received[i];
+            }
+            continue;
+        }
+        buffer[*size] = '\0';
+        if (*size > 0)
+        {
+            addWord(buffer);
+        }
+        *size = 0;
     }
+    return 0;
 }
 
-/*The purpose of the calculateLevenshtein function is to compare each word entered by the user with every word in the dictionary.
-This is achieved through the outer for loop specified in the code snippet. The function calculates the difference between two words (character differences).
-For example, if two words are identical, the difference will be 0. On the other hand, for an example like "hello" and "hollow," the difference will be 2.
-The reason it returns an array is as follows: first, it compares all the elements in the dictionary with the input and selects the top matches
-based on the specified limit. The topWords variable holds up to the limit number of words and their corresponding differences with any word
-in the user's input sentence. Returning an array significantly simplifies the process in this code snippet.*/
-LevInfo *calculateLevenshtein(const char *s1)
+/*The purpose of this function is to publish a word that a worker has sent. The supervisor adds it to its own dictionary and to the log,
+and sends it to every worker; the worker that sent it has the word already and skips it.
+A worker that is busy for a moment takes the word later from its backlog. Only a worker whose backlog has grown beyond
+WORKER_BACKLOG_BYTES, or whose socket has failed, is stopped and started again with the whole dictionary.*/
+void publishWord(const char *word)
 {
-    LevInfo *allWords = (LevInfo *)malloc(arraySize * sizeof(LevInfo));
-    for (int m = 0; m < arraySize; m++)
-    {
-        int len1 = strlen(s1);
-        int len2 = strlen(dict_array[m]);
-        int dp[len1 + 1][len2 + 1];
+    char line[INPUT_CHARACTER_LIMIT + 2];
+    int length;
 
-        for (int i = 0; i <= len1; i++)
-            dp[i][0] = i;
-        for (int j = 0; j <= len2; j++)
-            dp[0][j] = j;
+    if (findWord(word) != NO_WORD)
+    {
+        return; // two workers have added the same word
+    }
+    insertDictionaryWord(word);
+    reclaimMemory();
+    logDictionaryWord(word);
 
-        for (int i = 1; i <= len1; i++)
+    length = snprintf(line, sizeof(line), "%s\n", word);
+    for (int i = 0; i < worker_processes; i++)
+    {
+        WorkerProcess *worker = &workers[i];
+        if (worker->socket == -1)
         {
-            for (int j = 1; j <= len2; j++)
-            {
-                int cost = (s1[i - 1] == dict_array[m][j - 1]) ? 0 : 1;
-                dp[i][j] = dp[i - 1][j - 1] + cost;
-                if (dp[i - 1][j] + 1 < dp[i][j])
-                    dp[i][j] = dp[i - 1][j] + 1;
-                if (dp[i][j - 1] + 1 < dp[i][j])
-                    dp[i][j] = dp[i][j - 1] + 1;
-            }
+            continue;
+        }
+        queueWorkerWords(worker, line, length);
+        if (!worker->blocked && flushWorkerBacklog(worker) < 0)
+        {
+            stopWorker(worker); // the worker has closed its end, it has crashed
+        }
+        else if (worker->backlog_length - worker->backlog_sent > WORKER_BACKLOG_BYTES)
+        {
+            fprintf(stderr, "Worker process %d does not read the new words, it is started again\n", i);
+            stopWorker(worker);
         }
-        // the results are transferred one by one to the array.
-        LevInfo result;
-        strcpy(result.stringName, dict_array[m]);
-        result.diff = dp[len1][len2];
-        allWords[m] = result;
     }
-    /*The desired situation in the project document is to return the number of words and the differences of those words with
-    a certain limit and the closest limit number. so an extra function was used.*/
-    LevInfo *final = TopWords(allWords, arraySize);
-    return final;
 }
 
-/*The purpose of using the TopWords function is to select the closest words from the entire dictionary based on the specified limit.
-The LevInfo array, which contains all the dictionary words, is first sorted using the compare method written for the qsort function.
-Then, the top words up to the specified limit are transferred to another array, which is returned.
-The original array is then freed to release the allocated memory.*/
-LevInfo *TopWords(LevInfo *allWords, int totalWords)
+/*The purpose of this function is to add a word that the supervisor has published to the dictionary of a worker process.*/
+void acceptPublishedWord(const char *word)
 {
-    LevInfo *TopLevenshtein = (LevInfo *)malloc(LEVENSHTEIN_LIST_LIMIT * sizeof(LevInfo));
-    qsort(allWords, arraySize, sizeof(LevInfo), compareLevInfo);
-    for (int i = 0; i < LEVENSHTEIN_LIST_LIMIT; i++)
+    if (findWord(word) == NO_WORD)
     {
-        TopLevenshtein[i] = allWords[i];
+        insertDictionaryWord(word);
+        reclaimMemory();
     }
-    free(allWords);
-    return TopLevenshtein;
 }
 
-/*Compare method for TopWords.First,the method is checking for numbers.If the numbers are the same then it is checking for strings.*/
-int compareLevInfo(const void *a, const void *b)
+/*The purpose of this function is to send a word that a client of a worker process has added to the supervisor.
+The line is short and the supervisor always reads its sockets, so the write does not wait.*/
+void sendWordToSupervisor(const char *word)
 {
-    const LevInfo *infoA = (const LevInfo *)a;
-    const LevInfo *infoB = (const LevInfo *)b;
+    char line[INPUT_CHARACTER_LIMIT + 2];
+    int length = snprintf(line, sizeof(line), "%s\n", word);
 
-    // Compare diff values first
-    if (infoA->diff < infoB->diff)
+    if (writeAll(supervisor_socket, line, length) != 0)
     {
-        return -1; //
+        perror("The word could not be sent to the supervisor");
     }
-    else if (infoA->diff > infoB->diff)
+}
+
+// Statistics Informations
+
+/*The server measures how long every stage of a request takes, so a slow server shows where its time goes.
+A measurement is one call of recordStage: it finds the bucket of the duration and increments it in the histogram of the
+current thread, nothing is shared between the threads and nothing is calculated until somebody asks for the statistics
+with STATS (telnet), stats (batch protocol) or --stats-file. Then the histograms of all threads are added together.
+A histogram that is read while its thread writes it can be one measurement behind, which does not matter for statistics.*/
+
+/*The purpose of this function is to give the time of a monotonic clock in nanoseconds, for measuring the stages.*/
+uint64_t monotonicNanoseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+/*The purpose of this function is to create the statistics of the event loop and of the workers, count - 1 of them.*/
+void createStatistics(int count)
+{
+    statistics = calloc(count, sizeof(ThreadStatistics));
+    if (statistics == NULL)
     {
-        return 1;
+        perror("Error allocating memory");
+        exit(EXIT_FAILURE);
     }
-    else
+    statistics_count = count;
+}
+
+/*The purpose of this function is to add one duration of a stage to the histogram of the current thread.*/
+void recordStage(Stage stage, uint64_t nanoseconds)
+{
+    ThreadStatistics *own = thread_statistics;
+    if (own == NULL)
     {
-        // if diff is equal, sort by stringName
-        return strcmp(infoA->stringName, infoB->stringName);
+        return;
     }
+    Histogram *histogram = &own->stage[stage];
+    int bucket = histogramBucket(nanoseconds);
+    atomic_store_explicit(&histogram->count[bucket], atomic_load_explicit(&histogram->count[bucket], memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_store_explicit(&histogram->sum, atomic_load_explicit(&histogram->sum, memory_order_relaxed) + nanoseconds, memory_order_relaxed);
 }
 
-/*The purpose of the function is to receive input via telnet.
-In this function, the input received is not separated into its parts in any way and is taken as is.
-Necessary error messages are printed based on the problems specified in the project document related to the input.
-Regardless, the return status solves the memory problem with the free placed in the main code.*/
-/*The getInput function will also be used in threadFunction in the future,
-where the main purpose is to get the desired input from the user rather than returning error messages,
-so the error messages are related to the actual string received from the user.*/
-char *getInput(int newSocket)
+/*The bucket of a duration: the durations below HISTOGRAM_SUB_BUCKETS nanoseconds have their own bucket,
+a longer one is found by its highest bit and the 3 bits after it.*/
+int histogramBucket(uint64_t nanoseconds)
 {
-    /*the data received from the user is put into the buffer*/
-    /*Limit=100+(\r\n)+2 for accept,101 character+\r for reject*/
-    char *buffer = malloc(INPUT_CHARACTER_LIMIT + 2);
+    if (nanoseconds < HISTOGRAM_SUB_BUCKETS)
+    {
+        return nanoseconds;
+    }
+    int exponent = 63 - __builtin_clzll(nanoseconds); // at least 3
+    int sub_bucket = (nanoseconds >> (exponent - 3)) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return (exponent - 2) * HISTOGRAM_SUB_BUCKETS + sub_bucket;
+}
 
-    int bytes_received;
-    /*The recv function returns an integer value, and this integer value is actually related to how many characters were received.*/
+/*The first duration (in nanoseconds) that is after a bucket, the value that is reported for the bucket.*/
+uint64_t bucketLimit(int bucket)
+{
+    if (bucket < HISTOGRAM_SUB_BUCKETS)
+    {
+        return bucket + 1;
+    }
+    int exponent = bucket / HISTOGRAM_SUB_BUCKETS + 2;
+    uint64_t first = (uint64_t)(HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS) << (exponent - 3);
+    return first + ((uint64_t)1 << (exponent - 3));
+}
 
-    bytes_received = recv(newSocket, buffer, INPUT_CHARACTER_LIMIT + 2, 0);
-    if (bytes_received <= 0)
+/*The purpose of this function is to add the histograms of a stage of every thread.*/
+void summarizeStage(Stage stage, StageSummary *summary)
+{
+    memset(summary, 0, sizeof(StageSummary));
+    for (int t = 0; t < statistics_count; t++)
     {
-        error_message = "\nError: Client disconnected or recv failed\n";
-        return buffer;
+        Histogram *histogram = &statistics[t].stage[stage];
+        for (int b = 0; b < HISTOGRAM_BUCKETS; b++)
+        {
+            uint64_t count = atomic_load_explicit(&histogram->count[b], memory_order_relaxed);
+            summary->count[b] += count;
+            summary->total += count;
+        }
+        summary->sum += atomic_load_explicit(&histogram->sum, memory_order_relaxed);
     }
+}
 
-    /*In the usage function of telnet, it puts \r\n at the end of the sentence received with the recv function, regardless of the recv function,
-    which causes 2 more characters to be received from the typed text. In this case, it affected the size of the buffer mentioned above.
-    It was also collected with the strscpn operation mentioned immediately 1 line below,
-    if the user enters more than the specified character limit, this limit is made to be detected input_limit+1 in the background,
-    regardless of the limit.\0 character is an important criterion in determining the size of the buffer and indicating that the characters are over.*/
-    buffer[strcspn(buffer, "\r\n")] = '\0';
-    buffer[INPUT_CHARACTER_LIMIT + 1] = '\0';
+/*The duration that fraction of the measurements of a stage did not exceed, 0 if there is no measurement.*/
+uint64_t stagePercentile(const StageSummary *summary, double fraction)
+{
+    uint64_t rank = (uint64_t)(fraction * summary->total);
+    uint64_t seen = 0;
 
-    if (strlen(buffer) > INPUT_CHARACTER_LIMIT)
+    if (summary->total == 0)
     {
-        error_message = "\nError: Input exceeds INPUT_CHARACTER_LIMIT characters.\n";
-
-        return buffer;
+        return 0;
     }
-    if (strlen(buffer) == 0)
+    if (rank >= summary->total)
     {
-        error_message = "\nError: Input is empty.\n";
-        return buffer;
+        rank = summary->total - 1;
     }
-
-    // Invalid
-    for (int i = 0; buffer[i] != '\0'; i++)
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++)
     {
-        /*The reason we accept '-' outside of the alphabet and spaces is that some words combine to create a different meaning.
-        Examples: fire-engine, well-known, well-being etc. but If the user writes hello-their-how-are-you or something, it will be perceived as a single word.*/
-        if (!isalpha(buffer[i]) && buffer[i] != ' ' && buffer[i] != '-') // Just alphabet characters or spaces or '-'
+        seen += summary->count[b];
+        if (seen > rank)
         {
-            error_message = "\nInvalid character is found\n";
-            return buffer;
+            return bucketLimit(b);
         }
     }
-    return buffer;
+    return UINT64_MAX; // only if a thread measured during the summary
 }
 
-/*The usage of this function is as follows. First of all, the purpose of the function is to create an array that will fit each text for a text with no specific number of lines.
-The array is first opened as 2 elements and then, after each incoming word, if the array is full, it doubles itself with realloc.*/
-void addString(char ***array, int *size, int *capacity, const char *newString)
+/*The purpose of this function is to write the statistics of the server as lines of text into buffer:
+one line for every stage with the number of measurements, the mean and the percentiles in microseconds,
+then the size of the dictionary, the counters of the result cache and the number of connected clients.
+Returns the number of lines.*/
+int formatStatistics(char *buffer, size_t size)
 {
-    if (*size >= *capacity)
+    StageSummary summary;
+    unsigned long hits, misses, evictions;
+    size_t offset = 0;
+    int lines = 0;
+
+    buffer[0] = '\0';
+    for (int stage = 0; stage < STAGE_COUNT && offset < size; stage++)
     {
-        *capacity *= 2;
-        *array = realloc(*array, *capacity * sizeof(char *));
-        if (*array == NULL)
-        {
-            perror("Error reallocating memory");
-            exit(EXIT_FAILURE);
-        }
+        summarizeStage(stage, &summary);
+        offset += snprintf(buffer + offset, size - offset,
+                           "stage %s count %lu mean_us %.1f p50_us %.1f p99_us %.1f p999_us %.1f max_us %.1f\n",
+                           stage_names[stage], (unsigned long)summary.total,
+                           summary.total == 0 ? 0.0 : summary.sum / 1e3 / summary.total,
+                           stagePercentile(&summary, 0.5) / 1e3, stagePercentile(&summary, 0.99) / 1e3,
+                           stagePercentile(&summary, 0.999) / 1e3, stagePercentile(&summary, 1.0) / 1e3);
+        lines++;
     }
-    (*array)[*size] = strdup(newString);
-    if ((*array)[*size] == NULL)
+    collectCacheCounters(&hits, &misses, &evictions);
+    if (offset < size)
     {
-        perror("Error duplicating string");
-        exit(EXIT_FAILURE);
+        offset += snprintf(buffer + offset, size - offset,
+                           "dictionary_words %u\ncache_hits %lu\ncache_misses %lu\ncache_evictions %lu\nactive_sessions %d\n",
+                           dictionaryVersion()->count, hits, misses, evictions, active_sessions);
+        lines += 5;
     }
-    (*size)++;
+#ifdef COUNT_ALLOCATIONS
+    if (offset < size)
+    {
+        offset += snprintf(buffer + offset, size - offset, "heap_allocations %lu\n", atomic_load(&heap_allocations));
+        lines++;
+    }
+#endif
+    return lines;
 }
 
-// Free the memory allocated for the dynamic array
-void freeArray(char **array, int size)
+/*The purpose of this function is to add the counters of the shards of the result cache.*/
+void collectCacheCounters(unsigned long *hits, unsigned long *misses, unsigned long *evictions)
 {
-    for (int i = 0; i < size; i++)
+    *hits = *misses = *evictions = 0;
+    for (int i = 0; i < CACHE_SHARDS; i++)
     {
-        free(array[i]);
+        CacheShard *shard = &cache_shards[i];
+        pthread_mutex_lock(&shard->mutex);
+        *hits += shard->hits;
+        *misses += shard->misses;
+        *evictions += shard->evictions;
+        pthread_mutex_unlock(&shard->mutex);
     }
-    free(array);
 }
 
-// Convert a string to lowercase
-void toLowerCase(char *str)
+/*The purpose of this function is to write the statistics in the text format of Prometheus, for example for the
+textfile collector of the node exporter. Every stage is a histogram whose buckets are the powers of two microseconds.
+The file is written under a temporary name and renamed, so the reader never sees half a file.
+Returns 0 on success and -1 on error.*/
+int writeStatisticsFile(const char *path)
 {
-    for (int i = 0; str[i]; i++)
+    char temporary_path[PATH_MAX];
+    StageSummary summary;
+    unsigned long hits, misses, evictions;
+    FILE *file;
+
+    snprintf(temporary_path, sizeof(temporary_path), "%s.tmp", path);
+    if ((file = fopen(temporary_path, "w")) == NULL)
     {
-        str[i] = tolower(str[i]);
+        return -1;
+    }
+    fprintf(file, "# HELP text_analysis_stage_seconds Duration of the stages of a request.\n");
+    fprintf(file, "# TYPE text_analysis_stage_seconds histogram\n");
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+    {
+        uint64_t cumulative = 0;
+        int b = 0;
+        summarizeStage(stage, &summary);
+        for (uint64_t limit = 1000; limit <= 64000000000ull; limit *= 2)
+        {
+            while (b < HISTOGRAM_BUCKETS && bucketLimit(b) <= limit)
+            {
+                cumulative += summary.count[b++];
+            }
+            fprintf(file, "text_analysis_stage_seconds_bucket{stage=\"%s\",le=\"%g\"} %lu\n", stage_names[stage], limit / 1e9, (unsigned long)cumulative);
+        }
+        fprintf(file, "text_analysis_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %lu\n", stage_names[stage], (unsigned long)summary.total);
+        fprintf(file, "text_analysis_stage_seconds_sum{stage=\"%s\"} %.9f\n", stage_names[stage], summary.sum / 1e9);
+        fprintf(file, "text_analysis_stage_seconds_count{stage=\"%s\"} %lu\n", stage_names[stage], (unsigned long)summary.total);
+    }
+    collectCacheCounters(&hits, &misses, &evictions);
+    fprintf(file, "# TYPE text_analysis_dictionary_words gauge\ntext_analysis_dictionary_words %u\n", dictionaryVersion()->count);
+    fprintf(file, "# TYPE text_analysis_cache_hits_total counter\ntext_analysis_cache_hits_total %lu\n", hits);
+    fprintf(file, "# TYPE text_analysis_cache_misses_total counter\ntext_analysis_cache_misses_total %lu\n", misses);
+    fprintf(file, "# TYPE text_analysis_cache_evictions_total counter\ntext_analysis_cache_evictions_total %lu\n", evictions);
+    fprintf(file, "# TYPE text_analysis_active_sessions gauge\ntext_analysis_active_sessions %d\n", active_sessions);
+    if (fclose(file) != 0 || rename(temporary_path, path) != 0)
+    {
+        unlink(temporary_path);
+        return -1;
     }
+    return 0;
 }
 
-// Function to release a list of String array
-void freeArrayList(char ***array_list, int *sizes, int count)
+// Benchmark Informations
+
+/*The purpose of this function is to give the time of a monotonic clock in seconds, for measuring durations.*/
+double monotonicSeconds(void)
 {
-    for (int i = 0; i < count; i++)
-    {
-        freeArray(array_list[i], sizes[i]);
-    }
-    free(array_list);
-    free(sizes);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
 }
 
-// Check if there are words in Array
-int isinArray(char **array, int size, const char *word)
+/*The purpose of this function is to measure the search engines alone, without the network and the threads.
+Dictionaries of 2000, 10000, 100000 and 1000000 random words (at most max_words) are built like the text dictionary,
+and words of 4 letters up to INPUT_CHARACTER_LIMIT letters are searched in them with the BK-tree, the scan and,
+if --symspell was given, calculateLevenshtein with the symmetric delete index in front of the tree.
+Every engine is measured for at least BENCHMARK_SECONDS and the average time of a search is printed, TopWords included.
+The random words are the same in every run, so two versions of the server can be compared.
+Returns 0.*/
+int runBenchmark(long max_words)
 {
-    for (int i = 0; i < size; i++)
+    static const long sizes[] = {2000, 10000, 100000, 1000000};
+    static const int query_lengths[] = {4, 8, 16, 32, 64, INPUT_CHARACTER_LIMIT};
+    static const char *engines[] = {"bk-tree", "scan", "symspell"};
+    unsigned int seed = 2021;
+
+    printf("%9s %7s %9s %9s %12s\n", "words", "length", "engine", "queries", "us/query");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && sizes[s] <= max_words; s++)
     {
-        if (strcmp(array[i], word) == 0)
+        int size = sizes[s];
+        char **words = malloc(size * sizeof(char *));
+        if (words == NULL)
+        {
+            perror("Error allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < size; i++)
+        {
+            int length = 2 + rand_r(&seed) % 7 + rand_r(&seed) % 7; // 2 ... 14 letters, mostly about 8
+            words[i] = malloc(length + 1);
+            if (words[i] == NULL)
+            {
+                perror("Error allocating memory");
+                exit(EXIT_FAILURE);
+            }
+            for (int j = 0; j < length; j++)
+            {
+                words[i][j] = 'a' + rand_r(&seed) % 26;
+            }
+            words[i][length] = '\0';
+        }
+        double start = monotonicSeconds();
+        buildDictionary(words, size);
+        if (symspell_distance > 0)
+        {
+            buildDeleteIndex();
+        }
+        freeArray(words, size);
+        printf("%9d %7s %9s %9s %12.0f\n", size, "-", "build", "-", (monotonicSeconds() - start) * 1e6);
+
+        for (size_t l = 0; l < sizeof(query_lengths) / sizeof(query_lengths[0]); l++)
         {
-            return 1; // the word is found
+            char queries[64][INPUT_CHARACTER_LIMIT + 1];
+            for (int q = 0; q < 64; q++)
+            {
+                makeBenchmarkQuery(queries[q], query_lengths[l], &seed);
+            }
+            for (int e = 0; e < 3; e++)
+            {
+                if (e == 2 && symspell_distance == 0)
+                {
+                    continue;
+                }
+                long count = 0;
+                double elapsed;
+                start = monotonicSeconds();
+                do
+                {
+                    const char *query = queries[count % 64];
+                    LevInfo result[LEVENSHTEIN_LIST_LIMIT];
+                    if (e == 0)
+                    {
+                        searchBKTree(bk_root, query, result);
+                    }
+                    else if (e == 1)
+                    {
+                        scanDictionary(query, result);
+                    }
+                    else
+                    {
+                        calculateLevenshtein(query, result);
+                    }
+                    count++;
+                    elapsed = monotonicSeconds() - start;
+                } while (count < 3 || elapsed < BENCHMARK_SECONDS);
+                printf("%9d %7d %9s %9ld %12.2f\n", size, query_lengths[l], engines[e], count, elapsed * 1e6 / count);
+            }
         }
+        fflush(stdout);
+
+        freeBKTree(bk_root);
+        bk_root = NULL;
+        freeDeleteIndex();
+        freeDictionary();
+        reclaimMemory();
     }
-    return 0; // the word is not found
+    freeArena(&scratch_arena);
+    return 0;
 }
 
-/*The main purpose of this function is to separate the received input according to the gaps.
-The most important difference from normal separation is that it creates a separate state for repeated words.
-Example: hello ege abdullah ege hello hello.
-Yes, this example may not make sense.However, we may not know exactly what the user will write and the sentence he will write may contain repetitive words.
-ThreadFunction contains the part of adding to the dictionary, which is one of the possibilities.Certain errors may occur in the cases added to the dictionary.
-If the user wants to add the first hello, the first hello state should appear in the Levensthein algorithm of the second hello.
-This piece of code also does this.The elements in the example are broken down as follows.
-first array:hello,ege,abdullah
-second array:hello,ege
-third array:hello
-then the allocated memory is freed with the free functions mentioned in the code fragment.*/
-char ***SplitbyRepeatedWords(const char *input, const char *delim, int **sizes, int *count)
+/*The purpose of this function is to make a query of the given length for the benchmark: a dictionary word,
+extended with random letters if it is shorter than length, with one letter changed.*/
+void makeBenchmarkQuery(char *query, int length, unsigned int *seed)
 {
-    char *temp = strdup(input); // Copy input string
-    char *token;
-    char **current_array = NULL;
-    int current_size = 0;
+    const char *word = dictionaryWord(rand_r(seed) % dict.count);
+    int copied = strlen(word) < (size_t)length ? (int)strlen(word) : length;
+
+    memcpy(query, word, copied);
+    for (int i = copied; i < length; i++)
+    {
+        query[i] = 'a' + rand_r(seed) % 26;
+    }
+    query[length] = '\0';
+    query[rand_r(seed) % length] = 'a' + rand_r(seed) % 26;
+}
 
-    char ***array_list = NULL; // List holding all arrays
-    int array_count = 0;
+// Load Test Informations
 
-    // first token
-    token = strtok(temp, delim);
+/*The purpose of this function is to load a server running on this machine the way real users do.
+connections telnet sessions are opened at the same time on PORT_NUMBER. Every connection sends the lines of the script
+as its sentences, answers n to every question about adding a word, and starts a new session after the last line
+until it has done sessions sessions. Without a script a few built-in sentences with misspelled words are used.
+The latency of a sentence is the time from sending it to the question about another input, so it contains the questions
+about the words too. At the end the throughput and the 50th, 99th and 99.9th percentiles of the latencies are printed.
+Returns 0, or 1 if the script could not be read, a connection could not be opened or the server stopped answering.*/
+int runLoadTest(int connections, int sessions, const char *script_path)
+{
+    static char *default_script[] = {"helo wrld", "the quick brown fox jumps over the lazy dog", "this is a tset of the servr"};
+    char **script = default_script;
+    int script_size = sizeof(default_script) / sizeof(default_script[0]);
+    int status = 0;
 
-    while (token != NULL)
+    if (script_path != NULL)
     {
-        // If the token already exists in current_array
-        toLowerCase(token);
-        if (isinArray(current_array, current_size, token))
+        if (readDictionaryWords(script_path, &script, &script_size) != 0 || script_size == 0)
         {
-            // Add the current array to the list
-            array_list = realloc(array_list, (array_count + 1) * sizeof(char **));
-            *sizes = realloc(*sizes, (array_count + 1) * sizeof(int));
-            array_list[array_count] = current_array;
-            (*sizes)[array_count] = current_size;
-            array_count++;
+            perror("The script could not be read");
+            return 1;
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    int epoll_instance = epoll_create1(0);
+    LoadClient *clients = calloc(connections, sizeof(LoadClient));
+    size_t expected = (size_t)connections * sessions * script_size;
+    double *latencies = malloc(expected * sizeof(double));
+    size_t completed = 0;
+    if (epoll_instance == -1 || clients == NULL || latencies == NULL)
+    {
+        perror("The load test could not be prepared");
+        exit(EXIT_FAILURE);
+    }
 
-            // Start a new array
-            current_array = NULL;
-            current_size = 0;
+    double start = monotonicSeconds();
+    int active = 0;
+    for (int i = 0; i < connections; i++)
+    {
+        clients[i].sessions_left = sessions - 1;
+        if (connectLoadClient(&clients[i], epoll_instance) != 0)
+        {
+            perror("Could not connect to the server");
+            status = 1;
+            break;
         }
+        active++;
+    }
 
-        // Add token to current_array
-        char **temp_array = realloc(current_array, (current_size + 1) * sizeof(char *));
-        if (temp_array == NULL)
+    struct epoll_event events[MAX_EVENTS];
+    while (status == 0 && active > 0)
+    {
+        int count = epoll_wait(epoll_instance, events, MAX_EVENTS, 10000);
+        if (count <= 0)
         {
-            error_message = "\nMemory allocation failed\n";
-            freeArray(current_array, current_size);
-            free(temp);
-            freeArrayList(array_list, *sizes, array_count);
-            return NULL;
+            fprintf(stderr, "The server did not answer for 10 seconds\n");
+            status = 1;
+            break;
         }
-        current_array = temp_array;
-        current_array[current_size] = strdup(token);
-        current_size++;
+        for (int e = 0; e < count; e++)
+        {
+            LoadClient *client = events[e].data.ptr;
+            ssize_t received;
+            bool closed = false;
+            while (true)
+            {
+                if (client->used == LOAD_BUFFER_SIZE)
+                {
+                    // No prompt is longer than 64 characters, the rest of a full buffer is only the answer of the words
+                    memmove(client->buffer, client->buffer + LOAD_BUFFER_SIZE - 64, 64);
+                    client->used = 64;
+                }
+                received = recv(client->socket, client->buffer + client->used, LOAD_BUFFER_SIZE - client->used, 0);
+                if (received <= 0)
+                {
+                    closed = received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+                    break;
+                }
+                client->used += received;
+            }
+
+            /*Every prompt of the server is answered in the order they were received.*/
+            while (true)
+            {
+                static const char *prompts[] = {"input string:\n", "(y/N):", "(y|Y):"};
+                char *first = NULL;
+                int prompt = -1;
+                for (int p = 0; p < 3; p++)
+                {
+                    char *found = memmem(client->buffer, client->used, prompts[p], strlen(prompts[p]));
+                    if (found != NULL && (first == NULL || found < first))
+                    {
+                        first = found;
+                        prompt = p;
+                    }
+                }
+                if (first == NULL)
+                {
+                    break;
+                }
+                size_t consumed = first - client->buffer + strlen(prompts[prompt]);
+                memmove(client->buffer, client->buffer + consumed, client->used - consumed);
+                client->used -= consumed;
+
+                if (prompt == 0)
+                {
+                    client->sent = monotonicSeconds();
+                    sendLoadLine(client, script[client->next_sentence++]);
+                }
+                else if (prompt == 1)
+                {
+                    sendLoadLine(client, "n");
+                }
+                else
+                {
+                    if (completed < expected)
+                    {
+                        latencies[completed++] = monotonicSeconds() - client->sent;
+                    }
+                    sendLoadLine(client, client->next_sentence < script_size ? "y" : "n");
+                }
+            }
 
-        // Next token
-        token = strtok(NULL, delim);
+            if (closed)
+            {
+                close(client->socket);
+                client->socket = 0;
+                active--;
+                if (client->sessions_left > 0)
+                {
+                    client->sessions_left--;
+                    client->next_sentence = 0;
+                    client->used = 0;
+                    if (connectLoadClient(client, epoll_instance) != 0)
+                    {
+                        perror("Could not connect to the server");
+                        status = 1;
+                        break;
+                    }
+                    active++;
+                }
+            }
+        }
     }
+    double elapsed = monotonicSeconds() - start;
 
-    // Add the last remaining array to the list
-    if (current_size > 0)
+    qsort(latencies, completed, sizeof(double), compareSeconds);
+    printf("%zu of %zu sentences in %.3f s, %.1f sentences/s\n", completed, expected, elapsed, completed / elapsed);
+    if (completed > 0)
     {
-        array_list = realloc(array_list, (array_count + 1) * sizeof(char **));
-        *sizes = realloc(*sizes, (array_count + 1) * sizeof(int));
-        array_list[array_count] = current_array;
-        (*sizes)[array_count] = current_size;
-        array_count++;
+        printf("latency p50 %.3f ms, p99 %.3f ms, p999 %.3f ms\n", latencies[(size_t)(0.5 * (completed - 1))] * 1e3,
+               latencies[(size_t)(0.99 * (completed - 1))] * 1e3, latencies[(size_t)(0.999 * (completed - 1))] * 1e3);
     }
 
-    free(temp); // Clear copied string
-    *count = array_count;
-    return array_list;
+    for (int i = 0; i < connections; i++)
+    {
+        if (clients[i].socket > 0)
+        {
+            close(clients[i].socket);
+        }
+    }
+    free(clients);
+    free(latencies);
+    close(epoll_instance);
+    if (script != default_script)
+    {
+        freeArray(script, script_size);
+    }
+    return status != 0 || completed < expected;
 }
 
-int compareStrings(const void *a, const void *b) // compare two strings according to their ascii code (letter by letter comparison case)
+/*The purpose of this function is to open a new session of a load test client on the server of this machine.
+The socket is connected before it is made non-blocking, so the first read already waits for the greeting.
+Returns 0 on success and -1 on error.*/
+int connectLoadClient(LoadClient *client, int epoll_instance)
 {
-    const char *strA = *(const char **)a;
-    const char *strB = *(const char **)b;
-    return strcmp(strA, strB);
+    struct sockaddr_in server;
+    struct epoll_event event;
+
+    client->socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (client->socket == -1)
+    {
+        return -1;
+    }
+    server.sin_family = AF_INET;
+    server.sin_addr.s_addr = inet_addr("127.0.0.1");
+    server.sin_port = htons(PORT_NUMBER);
+    if (connect(client->socket, (struct sockaddr *)&server, sizeof(server)) == -1)
+    {
+        close(client->socket);
+        client->socket = 0;
+        return -1;
+    }
+    fcntl(client->socket, F_SETFL, fcntl(client->socket, F_GETFL) | O_NONBLOCK);
+    event.events = EPOLLIN;
+    event.data.ptr = client;
+    return epoll_ctl(epoll_instance, EPOLL_CTL_ADD, client->socket, &event);
 }
 
-/*This is an escape command. The purpose of this command is to clear the terminal when the user wants to enter input once more.*/
-void clearScreen(int client_fd)
+/*The purpose of this function is to send one line of a load test client. The lines are short,
+so they always fit into the empty send buffer of the socket.*/
+void sendLoadLine(LoadClient *client, const char *line)
 {
-    char clear_cmd[] = "\033[H\033[J";
-    send(client_fd, clear_cmd, strlen(clear_cmd), 0);
+    char buffer[INPUT_CHARACTER_LIMIT + 3];
+    int length = snprintf(buffer, sizeof(buffer), "%s\r\n", line);
+    send(client->socket, buffer, length, MSG_NOSIGNAL);
 }
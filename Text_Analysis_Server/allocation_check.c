@@ -0,0 +1,187 @@
+/*This program checks that the batch requests of a client in the steady state do not allocate anything from the heap.
+The server file is included with COUNT_ALLOCATIONS and its main renamed, and its event loop is run in a thread.
+A client sends rounds of pipelined requests (correct, brief correct, report and a document) to BATCH_PORT_NUMBER.
+After the warm rounds every arena, cache entry and buffer of the session exists, so heap_allocations must not grow
+during the measured rounds. The client only uses buffers on the stack, because the macros count its allocations too.
+
+Build and run it from this directory, with ThreadSanitizer or AddressSanitizer if wanted:
+    gcc -O2 -pthread -o allocation_check allocation_check.c -lm
+    ./allocation_check [warm rounds (20)] [measured rounds (200)]
+It prints the allocations of the measured rounds, and returns 1 if there was one.*/
+
+#define COUNT_ALLOCATIONS
+#define main serverMain
+#include "GROUP_29_2021510025_abdullah_demirci_2021510070_ege_yildirim_Project.c"
+#undef main
+
+#define CHECK_DICTIONARY_FILE "../basic_english2000.txt"
+#define CHECK_DOCUMENT "Teh quick brwn fox jumpd over the lazzy dog, and then it ran bak to its hous.\n"
+#define CHECK_CONNECT_TRIES 100
+
+/*Every round is one write of these requests, so they are calculated at the same time. Each reply ends with one line
+that starts with OUTPUT, ERROR or END. The add policy is not used, because a new word of the dictionary is allocated.*/
+const char *check_requests[] = {
+    "correct the wether is god today\n",
+    "brief correct a smal hous with a gren door\n",
+    "report sientific results of the experment\n",
+    "correct thiss sentence is far too long to be a sentence of the server because it has many more characters than the limit of one hundred\n",
+};
+
+char check_round[1024];
+int check_round_length = 0;
+int check_replies = 0;
+
+/*The purpose of this function is to write the requests of one round into check_round once.*/
+void prepareRound(void)
+{
+    for (size_t i = 0; i < sizeof(check_requests) / sizeof(check_requests[0]); i++)
+    {
+        check_round_length += snprintf(check_round + check_round_length, sizeof(check_round) - check_round_length, "%s", check_requests[i]);
+        check_replies++;
+    }
+    check_round_length += snprintf(check_round + check_round_length, sizeof(check_round) - check_round_length,
+                                   "document %zu\n%s", strlen(CHECK_DOCUMENT), CHECK_DOCUMENT);
+    check_replies++;
+}
+
+/*The purpose of this function is to run the event loop of the server in its own thread.*/
+void *runServer(void *arg)
+{
+    (void)arg;
+    serveClients();
+    return NULL;
+}
+
+/*The purpose of this function is to connect to the batch port, trying again until the server listens.
+Returns the socket, or -1 if the server did not start.*/
+int connectClient(void)
+{
+    struct sockaddr_in server;
+
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    server.sin_port = htons(BATCH_PORT_NUMBER);
+    for (int i = 0; i < CHECK_CONNECT_TRIES; i++)
+    {
+        int sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock == -1)
+        {
+            return -1;
+        }
+        if (connect(sock, (struct sockaddr *)&server, sizeof(server)) == 0)
+        {
+            return sock;
+        }
+        close(sock);
+        usleep(50000);
+    }
+    return -1;
+}
+
+/*The purpose of this function is to send one round and to read until every request of it is answered.
+The bytes of a CHUNK frame are skipped, so a corrected document can not be taken for a reply line.
+Returns 0 after the round, -1 if the connection was closed.*/
+int runRound(int sock)
+{
+    char buffer[4096], line[512];
+    int line_length = 0, replies = 0;
+    long skip = 0;
+
+    if (send(sock, check_round, check_round_length, 0) != check_round_length)
+    {
+        return -1;
+    }
+    while (replies < check_replies)
+    {
+        ssize_t received = recv(sock, buffer, sizeof(buffer), 0);
+        if (received <= 0)
+        {
+            return -1;
+        }
+        for (ssize_t i = 0; i < received; i++)
+        {
+            if (skip > 0)
+            {
+                skip--;
+                continue;
+            }
+            if (buffer[i] != '\n')
+            {
+                if (line_length < (int)sizeof(line) - 1)
+                {
+                    line[line_length++] = buffer[i];
+                }
+                continue;
+            }
+            line[line_length] = '\0';
+            line_length = 0;
+            if (strncmp(line, "CHUNK ", 6) == 0)
+            {
+                skip = atol(line + 6);
+            }
+            else if (strncmp(line, "OUTPUT ", 7) == 0 || strncmp(line, "ERROR ", 6) == 0 || strncmp(line, "END ", 4) == 0)
+            {
+                replies++;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int warm_rounds = argc > 1 ? atoi(argv[1]) : 20;
+    int rounds = argc > 2 ? atoi(argv[2]) : 200;
+    pthread_t server_thread;
+    struct sigaction action;
+
+    selectDistanceKernel();
+    createCache(cache_budget);
+    if (loadDictionary(CHECK_DICTIONARY_FILE) != 0)
+    {
+        perror("The dictionary could not be loaded");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handleSignal;
+    sigaction(SIGTERM, &action, NULL);
+    prepareRound();
+    pthread_create(&server_thread, NULL, runServer, NULL);
+
+    int sock = connectClient();
+    if (sock == -1)
+    {
+        perror("Could not connect to the server");
+        return 1;
+    }
+    int failed = 0;
+    for (int r = 0; r < warm_rounds && !failed; r++)
+    {
+        failed = runRound(sock) != 0;
+    }
+    unsigned long before = atomic_load(&heap_allocations);
+    for (int r = 0; r < rounds && !failed; r++)
+    {
+        failed = runRound(sock) != 0;
+    }
+    unsigned long allocations = atomic_load(&heap_allocations) - before;
+    if (failed)
+    {
+        fprintf(stderr, "The server closed the connection\n");
+    }
+    printf("rounds=%d requests=%d allocations=%lu\n", rounds, rounds * check_replies, allocations);
+
+    close(sock);
+    usleep(100000); // the event loop closes the session before it is stopped
+    pthread_kill(server_thread, SIGTERM); // the handler runs in the thread of the event loop, like in the server
+    pthread_join(server_thread, NULL);
+    freeCache();
+    freeBKTree(bk_root);
+    freeDictionary();
+    reclaimMemory();
+    freeSpareScans();
+    freeArena(&scratch_arena);
+    return failed || allocations != 0;
+}
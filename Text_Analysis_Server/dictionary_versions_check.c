@@ -0,0 +1,123 @@
+/*This program checks the versions of the dictionary (readDictionary, finishReading and the BK-tree that is changed while it is read).
+Four reader threads search random words without any lock while the main thread adds random words to the dictionary.
+Every answer is compared with the brute force answer over the words of the version that the reader took:
+the best difference must be the same, and every word of the answer must be in that version and have the difference given with it.
+The server file is included with its main renamed, so the check uses exactly the functions of the server.
+
+Build and run it from this directory, with ThreadSanitizer or AddressSanitizer if wanted:
+    gcc -O2 -pthread -o dictionary_versions_check dictionary_versions_check.c -lm
+    gcc -g -fsanitize=thread -pthread -o dictionary_versions_check dictionary_versions_check.c -lm
+    ./dictionary_versions_check [added words (3000)] [microseconds between two words (0)]
+It prints the number of checks and failed checks, and returns 1 if a check failed.*/
+
+#define main serverMain
+#include "GROUP_29_2021510025_abdullah_demirci_2021510070_ege_yildirim_Project.c"
+#undef main
+
+#define CHECK_READERS 4
+#define CHECK_DICTIONARY_FILE "../basic_english2000.txt"
+
+_Atomic int stop_readers = 0;
+_Atomic int failed_checks = 0;
+_Atomic int checks = 0;
+
+/*The purpose of this function is to make a random word of 1 to 6 letters from the first 8 letters,
+so the readers search words that the main thread has just added.*/
+void randomWord(char *word, unsigned *seed)
+{
+    int length = 1 + rand_r(seed) % 6;
+
+    for (int i = 0; i < length; i++)
+    {
+        word[i] = 'a' + rand_r(seed) % 8;
+    }
+    word[length] = '\0';
+}
+
+/*The purpose of this function is to search random words until the main thread has added all its words
+and to compare every answer with the brute force answer of the version that was read.*/
+void *checkReader(void *arg)
+{
+    unsigned seed = (unsigned)(long)arg * 7 + 1;
+    char word[8];
+    LevInfo result[LEVENSHTEIN_LIST_LIMIT];
+
+    worker_index = (int)(long)arg;
+    while (!atomic_load(&stop_readers))
+    {
+        randomWord(word, &seed);
+        int length = strlen(word);
+        readDictionary();
+        uint32_t count = reader_version->count;
+        calculateLevenshtein(word, result);
+
+        int best = INT_MAX;
+        for (uint32_t m = 0; m < count; m++)
+        {
+            int diff = levenshteinDistance(word, length, dictionaryWord(m), dictionaryLength(m));
+            if (diff < best)
+            {
+                best = diff;
+            }
+        }
+        bool correct = result[0].diff == best;
+        for (int i = 0; correct && i < LEVENSHTEIN_LIST_LIMIT && result[i].word != NO_WORD; i++)
+        {
+            correct = result[i].word < count &&
+                      levenshteinDistance(word, length, dictionaryWord(result[i].word), dictionaryLength(result[i].word)) == result[i].diff;
+        }
+        finishReading();
+        if (!correct)
+        {
+            atomic_fetch_add(&failed_checks, 1);
+        }
+        atomic_fetch_add(&checks, 1);
+    }
+    freeArena(&scratch_arena);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    pthread_t readers[CHECK_READERS];
+    int words = argc > 1 ? atoi(argv[1]) : 3000;
+    int pause = argc > 2 ? atoi(argv[2]) : 0;
+    unsigned seed = 99;
+    char word[8];
+
+    selectDistanceKernel();
+    createReaderSlots(CHECK_READERS);
+    if (loadDictionary(CHECK_DICTIONARY_FILE) != 0)
+    {
+        perror("The dictionary could not be loaded");
+        return 1;
+    }
+    for (long i = 0; i < CHECK_READERS; i++)
+    {
+        pthread_create(&readers[i], NULL, checkReader, (void *)i);
+    }
+    for (int k = 0; k < words; k++)
+    {
+        randomWord(word, &seed);
+        addDictionaryWord(word);
+        if (pause > 0)
+        {
+            usleep(pause);
+        }
+    }
+    atomic_store(&stop_readers, 1);
+    for (int i = 0; i < CHECK_READERS; i++)
+    {
+        pthread_join(readers[i], NULL);
+    }
+    printf("checks=%d failed=%d words=%u\n", atomic_load(&checks), atomic_load(&failed_checks), dict.count);
+
+    free(reader_slots);
+    reader_slots = NULL; // no reader is left, so every retired block is freed
+    reader_slot_count = 0;
+    freeBKTree(bk_root);
+    freeDictionary();
+    reclaimMemory();
+    freeArena(&scratch_arena);
+    return atomic_load(&failed_checks) != 0;
+}
@@ -0,0 +1,234 @@
+/*This program checks that the fast ways of calculating differences give the same answers as the plain ones.
+First the distance kernels (distancesScalar and, if the CPU has them, distancesSSE41 and distancesAVX2) and boundedLevenshtein
+are compared with levenshteinDistance on random word pairs of up to 140 characters with random bounds.
+Then a dictionary of random words is searched with every engine: the BK-tree, the serial scan, the parallel scan of the workers
+and the symmetric delete index in front of the tree. Every answer must be the same as the answer of the serial scan, word by word.
+The server file is included with its main renamed, so the check uses exactly the functions of the server.
+
+Build and run it from this directory, with ThreadSanitizer or AddressSanitizer if wanted:
+    gcc -O2 -pthread -o search_engines_check search_engines_check.c -lm
+    ./search_engines_check [word pairs (400000)] [dictionary words (150000)] [queries (300)]
+It prints the number of checks and differences of both parts, and returns 1 if there was a difference.*/
+
+#define main serverMain
+#include "GROUP_29_2021510025_abdullah_demirci_2021510070_ege_yildirim_Project.c"
+#undef main
+
+#define CHECK_WORD_LIMIT 140
+#define CHECK_BATCH 8
+#define CHECK_WORKERS 4
+#define CHECK_SYMSPELL_DISTANCE 2
+
+/*The purpose of this function is to make a random word of at most limit characters.
+Most words use only 4 letters, so the pairs also have small differences and the bounds are hit both ways.*/
+void randomCheckWord(char *word, int limit, unsigned *seed)
+{
+    int length = rand_r(seed) % (limit + 1);
+    int letters = rand_r(seed) % 4 == 0 ? 26 : 4;
+
+    for (int i = 0; i < length; i++)
+    {
+        word[i] = 'a' + rand_r(seed) % letters;
+    }
+    word[length] = '\0';
+}
+
+/*The purpose of this function is to compare the kernels and boundedLevenshtein with levenshteinDistance.
+A difference more than the bound must be given as bound + 1. Returns the number of differences.*/
+long checkKernels(long pairs, long *checks)
+{
+    DistanceKernel kernels[3];
+    const char *names[3];
+    int kernel_count = 0;
+    unsigned seed = 2021;
+    char query_text[CHECK_WORD_LIMIT + 1];
+    char texts[CHECK_BATCH][CHECK_WORD_LIMIT + 1];
+    const char *words[CHECK_BATCH];
+    int lengths[CHECK_BATCH], bounds[CHECK_BATCH], expected[CHECK_BATCH], out[CHECK_BATCH];
+    LevQuery query;
+    long differences = 0;
+
+    kernels[kernel_count] = distancesScalar;
+    names[kernel_count++] = "scalar";
+#ifdef LEVENSHTEIN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        kernels[kernel_count] = distancesSSE41;
+        names[kernel_count++] = "sse4.1";
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        kernels[kernel_count] = distancesAVX2;
+        names[kernel_count++] = "avx2";
+    }
+#endif
+
+    for (long p = 0; p < pairs;)
+    {
+        randomCheckWord(query_text, CHECK_WORD_LIMIT, &seed);
+        int query_length = strlen(query_text);
+        prepareQuery(&query, query_text, query_length);
+        int count = 1 + rand_r(&seed) % CHECK_BATCH;
+        p += count;
+        for (int i = 0; i < count; i++)
+        {
+            randomCheckWord(texts[i], CHECK_WORD_LIMIT, &seed);
+            words[i] = texts[i];
+            lengths[i] = strlen(texts[i]);
+            bounds[i] = rand_r(&seed) % 4 == 0 ? NO_BOUND : rand_r(&seed) % (CHECK_WORD_LIMIT / 4);
+            int distance = levenshteinDistance(query_text, query_length, texts[i], lengths[i]);
+            expected[i] = distance > bounds[i] ? bounds[i] + 1 : distance;
+            if (boundedLevenshtein(query_text, query_length, texts[i], lengths[i], bounds[i]) != expected[i])
+            {
+                fprintf(stderr, "boundedLevenshtein: \"%s\" \"%s\" bound %d\n", query_text, texts[i], bounds[i]);
+                differences++;
+            }
+            (*checks)++;
+        }
+        for (int k = 0; k < kernel_count; k++)
+        {
+            kernels[k](&query, words, lengths, bounds, count, out);
+            for (int i = 0; i < count; i++)
+            {
+                if (out[i] != expected[i])
+                {
+                    fprintf(stderr, "%s: \"%s\" \"%s\" bound %d gives %d instead of %d\n", names[k], query_text, texts[i], bounds[i], out[i], expected[i]);
+                    differences++;
+                }
+                (*checks)++;
+            }
+        }
+    }
+    return differences;
+}
+
+/*The purpose of this function is to compare two answers word by word. Returns true if they are the same.*/
+bool sameResult(const LevInfo *a, const LevInfo *b)
+{
+    for (int i = 0; i < LEVENSHTEIN_LIST_LIMIT; i++)
+    {
+        if (a[i].word != b[i].word || (a[i].word != NO_WORD && a[i].diff != b[i].diff))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*The purpose of this function is to build a dictionary of different random words like the benchmark does
+and to compare the answers of every engine with the serial scan. Returns the number of differences.*/
+long checkEngines(int size, int query_count, long *checks)
+{
+    static const char *engines[] = {"bk-tree", "parallel scan", "symspell"};
+    unsigned seed = 2021;
+    char **words = malloc(size * sizeof(char *));
+    LevInfo (*expected)[LEVENSHTEIN_LIST_LIMIT] = malloc(query_count * sizeof(*expected));
+    char (*queries)[INPUT_CHARACTER_LIMIT + 1] = malloc(query_count * sizeof(*queries));
+    long differences = 0;
+    int unique = 0;
+
+    if (words == NULL || expected == NULL || queries == NULL)
+    {
+        perror("Error allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < size; i++)
+    {
+        int length = 2 + rand_r(&seed) % 7 + rand_r(&seed) % 7;
+        words[i] = malloc(length + 1);
+        if (words[i] == NULL)
+        {
+            perror("Error allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        for (int j = 0; j < length; j++)
+        {
+            words[i][j] = 'a' + rand_r(&seed) % 26;
+        }
+        words[i][length] = '\0';
+    }
+    // A word that is twice in the dictionary would have two equal places in an answer, so the words are made different.
+    qsort(words, size, sizeof(char *), compareWords);
+    for (int i = 0; i < size; i++)
+    {
+        if (unique > 0 && strcmp(words[i], words[unique - 1]) == 0)
+        {
+            free(words[i]);
+            continue;
+        }
+        words[unique++] = words[i];
+    }
+    buildDictionary(words, unique);
+    symspell_distance = CHECK_SYMSPELL_DISTANCE;
+    buildDeleteIndex();
+    freeArray(words, unique);
+
+    /*The pool does not exist yet, so scanDictionary scans alone.*/
+    for (int q = 0; q < query_count; q++)
+    {
+        int length = 4 + rand_r(&seed) % (INPUT_CHARACTER_LIMIT / 4);
+        makeBenchmarkQuery(queries[q], length, &seed);
+        scanDictionary(queries[q], expected[q]);
+    }
+
+    if (createThreadPool(&pool, CHECK_WORKERS) != 0)
+    {
+        perror("The thread pool could not be created");
+        exit(EXIT_FAILURE);
+    }
+    for (int q = 0; q < query_count; q++)
+    {
+        for (int e = 0; e < 3; e++)
+        {
+            LevInfo result[LEVENSHTEIN_LIST_LIMIT];
+            if (e == 0)
+            {
+                searchBKTree(bk_root, queries[q], result);
+            }
+            else if (e == 1)
+            {
+                scanDictionary(queries[q], result);
+            }
+            else
+            {
+                calculateLevenshtein(queries[q], result);
+            }
+            if (!sameResult(result, expected[q]))
+            {
+                fprintf(stderr, "%s: the answer for \"%s\" is not the answer of the serial scan\n", engines[e], queries[q]);
+                differences++;
+            }
+            (*checks)++;
+        }
+    }
+    destroyThreadPool(&pool);
+
+    free(expected);
+    free(queries);
+    freeBKTree(bk_root);
+    bk_root = NULL;
+    freeDeleteIndex();
+    freeDictionary();
+    reclaimMemory();
+    freeSpareScans();
+    return differences;
+}
+
+int main(int argc, char *argv[])
+{
+    long pairs = argc > 1 ? atol(argv[1]) : 400000;
+    int size = argc > 2 ? atoi(argv[2]) : 150000;
+    int query_count = argc > 3 ? atoi(argv[3]) : 300;
+    long kernel_checks = 0, engine_checks = 0;
+
+    selectDistanceKernel();
+    long kernel_differences = checkKernels(pairs, &kernel_checks);
+    printf("kernels: checks=%ld differences=%ld\n", kernel_checks, kernel_differences);
+    fflush(stdout);
+    long engine_differences = checkEngines(size, query_count, &engine_checks);
+    printf("engines: checks=%ld differences=%ld\n", engine_checks, engine_differences);
+
+    freeArena(&scratch_arena);
+    return kernel_differences + engine_differences != 0;
+}